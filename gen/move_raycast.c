@@ -40,15 +40,25 @@ static uint64_t raycast(uint8_t src, uint8_t dest) {
   return result;
 }
 
-void gen_move_raycast(void) {
-  printf("uint64_t raycast[64][64] = {\n");
+// Squares strictly in between src and dest, if they are on a line.
+static uint64_t between(uint8_t src, uint8_t dest) {
+  uint64_t bits = (1ULL << src) | (1ULL << dest);
+  return raycast(src, dest) & raycast(dest, src) & ~bits;
+}
+
+// The whole line through src and dest, edge to edge, if there is one.
+static uint64_t line(uint8_t src, uint8_t dest) {
+  return raycast(src, dest) | raycast(dest, src);
+}
+
+static void print_table(const char* name, uint64_t (*fn)(uint8_t, uint8_t)) {
+  printf("const uint64_t %s[64][64] = {\n", name);
 
   for (uint8_t src = 0; src < 64; src++) {
     printf("{\n\t");
 
     for (uint8_t dest = 0; dest < 64; dest++) {
-      uint64_t btw = raycast(src, dest);
-      printf("0x%.16" PRIx64, btw);
+      printf("0x%.16" PRIx64, fn(src, dest));
       if (dest < 63) {
         printf(",");
         if (dest % 8 == 7)
@@ -66,3 +76,8 @@ void gen_move_raycast(void) {
 
   printf("};\n");
 }
+
+void gen_move_raycast(void) {
+  print_table("between", between);
+  print_table("line", line);
+}
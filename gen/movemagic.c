@@ -0,0 +1,6 @@
+void gen_movemagic_tables(void);
+
+int main(void) {
+  gen_movemagic_tables();
+  return 0;
+}
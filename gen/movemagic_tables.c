@@ -0,0 +1,152 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bitboard.h"
+#include "bitops.h"
+#include "movemagic-consts.h"
+#include "movemagic.h"
+
+// Slider attacks indexed by occupancy repeat themselves a lot: a rook on a1 has
+// 4096 occupancies to index but only 49 different sets of attacks. So each
+// table holds a 16-bit reference into a list of the distinct attack sets,
+// which is about a third of the size of storing the attacks directly.
+
+#define MAX_DISTINCT 8192
+
+static uint64_t compute_attacks(uint8_t pos,
+                                uint64_t occ,
+                                int8_t row_incr,
+                                int8_t col_incr) {
+  uint64_t attacks = 0;
+
+  int8_t init_row = (int8_t)board_row_of(pos);
+  int8_t init_col = (int8_t)board_col_of(pos);
+
+  for (int8_t row = init_row + row_incr, col = init_col + col_incr;
+       row < 8 && col < 8 && row >= 0 && col >= 0;
+       row = row + row_incr, col = col + col_incr) {
+    uint64_t bit = 1ULL << board_index_of((uint8_t)row, (uint8_t)col);
+    attacks |= bit;
+    if (occ & bit)
+      break;
+  }
+
+  return attacks;
+}
+
+static uint64_t rook_attacks(uint8_t pos, uint64_t occ) {
+  return compute_attacks(pos, occ, 1, 0) | compute_attacks(pos, occ, -1, 0) |
+         compute_attacks(pos, occ, 0, 1) | compute_attacks(pos, occ, 0, -1);
+}
+
+static uint64_t bishop_attacks(uint8_t pos, uint64_t occ) {
+  return compute_attacks(pos, occ, 1, 1) | compute_attacks(pos, occ, 1, -1) |
+         compute_attacks(pos, occ, -1, 1) | compute_attacks(pos, occ, -1, -1);
+}
+
+// The nth subset of the bits in mask. Going through n in order gives the same
+// order as PEXT.
+static uint64_t nth_subset(uint64_t n, uint64_t mask) {
+  uint64_t ret = 0;
+  for (uint8_t i = 0; mask; i++) {
+    uint64_t bit = mask & -mask;
+    mask &= mask - 1;
+    if (n & (1ULL << i))
+      ret |= bit;
+  }
+
+  return ret;
+}
+
+static size_t table_index(uint64_t n,
+                          uint64_t mask,
+                          uint64_t magic,
+                          uint8_t shift) {
+#if MOVEMAGIC_PEXT
+  (void)mask;
+  (void)magic;
+  (void)shift;
+  return n;
+#else
+  return nth_subset(n, mask) * magic >> shift;
+#endif
+}
+
+static size_t table_size(uint64_t mask, uint8_t shift) {
+#if MOVEMAGIC_PEXT
+  (void)shift;
+  return 1ULL << popcnt(mask);
+#else
+  (void)mask;
+  return 1ULL << (64 - shift);
+#endif
+}
+
+static void gen_piece(const char* name,
+                      const uint64_t* masks,
+                      const uint64_t* magics,
+                      const uint8_t* shifts,
+                      uint64_t (*attacks_fn)(uint8_t, uint64_t)) {
+  size_t total = 0;
+  for (uint8_t pos = 0; pos < 64; pos++)
+    total += table_size(masks[pos], shifts[pos]);
+
+  uint16_t* refs = calloc(total, sizeof(uint16_t));
+  uint64_t* distinct = malloc(MAX_DISTINCT * sizeof(uint64_t));
+  size_t num_distinct = 0;
+  size_t offsets[64];
+
+  size_t offset = 0;
+  for (uint8_t pos = 0; pos < 64; pos++) {
+    offsets[pos] = offset;
+
+    // Attacks from different squares never coincide, so only need to look for
+    // duplicates from this square.
+    size_t first = num_distinct;
+    for (uint64_t n = 0; n < (1ULL << popcnt(masks[pos])); n++) {
+      uint64_t attacks = attacks_fn(pos, nth_subset(n, masks[pos]));
+
+      size_t ref = first;
+      while (ref < num_distinct && distinct[ref] != attacks)
+        ref++;
+      if (ref == num_distinct) {
+        if (num_distinct == MAX_DISTINCT)
+          abort();
+        distinct[num_distinct++] = attacks;
+      }
+
+      refs[offset + table_index(n, masks[pos], magics[pos], shifts[pos])] =
+          (uint16_t)ref;
+    }
+
+    offset += table_size(masks[pos], shifts[pos]);
+  }
+
+  printf("static const uint64_t %s_attacks[%zu] = {\n\t", name, num_distinct);
+  for (size_t i = 0; i < num_distinct; i++)
+    printf("0x%.16" PRIx64 "%s", distinct[i],
+           i == num_distinct - 1 ? "\n" : (i % 4 == 3 ? ",\n\t" : ", "));
+  printf("};\n\n");
+
+  printf("static const uint16_t %s_refs[%zu] = {\n\t", name, total);
+  for (size_t i = 0; i < total; i++)
+    printf("%u%s", refs[i],
+           i == total - 1 ? "\n" : (i % 16 == 15 ? ",\n\t" : ", "));
+  printf("};\n\n");
+
+  printf("static const Entry %s_entries[64] = {\n", name);
+  for (uint8_t pos = 0; pos < 64; pos++)
+    printf("\t{0x%.16" PRIx64 ", 0x%.16" PRIx64 ", %s_refs + %zu, %u},\n",
+           masks[pos], magics[pos], name, offsets[pos], shifts[pos]);
+  printf("};\n\n");
+
+  free(refs);
+  free(distinct);
+}
+
+void gen_movemagic_tables(void) {
+  gen_piece("rook", r_mask, r_magic, r_shift, rook_attacks);
+  gen_piece("bishop", b_mask, b_magic, b_shift, bishop_attacks);
+}
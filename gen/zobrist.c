@@ -0,0 +1,6 @@
+void gen_zobrist_keys(void);
+
+int main(void) {
+  gen_zobrist_keys();
+  return 0;
+}
@@ -0,0 +1,211 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "types.h"
+
+// The keys only need to be random-looking and, importantly, the same on every
+// run and every machine, so that anything keyed off of them (the transposition
+// table, anything saved to disk) stays valid. A fixed-seed splitmix64 is plenty
+// for that.
+static uint64_t state = 0x6e616d656c657373ULL;
+
+static uint64_t zobrist_rand64(void) {
+  uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static void print_keys(const uint64_t* keys, int n) {
+  printf("\t");
+  for (int i = 0; i < n; i++) {
+    printf("0x%.16" PRIx64, keys[i]);
+
+    if (i < n - 1) {
+      printf(",");
+
+      if (i % 4 == 3)
+        printf("\n\t");
+      else
+        printf(" ");
+    }
+  }
+  printf("\n");
+}
+
+// Every move a piece other than a pawn could make on an empty board, keyed by
+// the zobrist difference it makes, for spotting positions which are one move
+// away from repeating. Cuckoo hashing with the two hash functions below keeps
+// each lookup down to at most two probes.
+#define CUCKOO_SIZE 8192
+#define CUCKOO_H1(key) ((key)&0x1FFF)
+#define CUCKOO_H2(key) (((key) >> 16) & 0x1FFF)
+
+typedef struct {
+  uint64_t key;
+  uint64_t between;
+  uint64_t squares;
+} CuckooEntry;
+
+static int on_board(int row, int col) {
+  return row >= 0 && row < 8 && col >= 0 && col < 8;
+}
+
+// Add the moves of piece from sq in direction (drow, dcol), going only one
+// step unless it slides.
+static void cuckoo_add_direction(CuckooEntry* table,
+                                 const uint64_t keys[64],
+                                 uint64_t black,
+                                 int sq,
+                                 int drow,
+                                 int dcol,
+                                 int slides) {
+  uint64_t between = 0;
+  for (int row = sq / 8 + drow, col = sq % 8 + dcol; on_board(row, col);
+       row += drow, col += dcol) {
+    int dest = row * 8 + col;
+
+    // Only the move from the lower square; the other way round has the same
+    // key.
+    if (dest > sq) {
+      CuckooEntry e = {keys[sq] ^ keys[dest] ^ black, between,
+                       1ULL << sq | 1ULL << dest};
+      size_t i = CUCKOO_H1(e.key);
+      for (int tries = 0;; tries++) {
+        if (tries == CUCKOO_SIZE)
+          abort();
+
+        CuckooEntry displaced = table[i];
+        table[i] = e;
+        if (displaced.key == 0)
+          break;
+
+        e = displaced;
+        i = i == CUCKOO_H1(e.key) ? CUCKOO_H2(e.key) : CUCKOO_H1(e.key);
+      }
+    }
+
+    if (!slides)
+      break;
+    between |= 1ULL << dest;
+  }
+}
+
+static void gen_cuckoo(uint64_t pos[2][6][64], uint64_t black) {
+  static const int king_dirs[8][2] = {{1, 0},  {-1, 0}, {0, 1},  {0, -1},
+                                      {1, 1},  {1, -1}, {-1, 1}, {-1, -1}};
+  static const int knight_dirs[8][2] = {{1, 2},  {2, 1},   {2, -1}, {1, -2},
+                                        {-1, 2}, {-2, 1}, {-2, -1}, {-1, -2}};
+
+  CuckooEntry* table = calloc(CUCKOO_SIZE, sizeof(CuckooEntry));
+  for (Color c = WHITE; c <= BLACK; c++) {
+    for (int sq = 0; sq < 64; sq++) {
+      for (int d = 0; d < 8; d++) {
+        const int* k = knight_dirs[d];
+        const int* r = king_dirs[d];
+        cuckoo_add_direction(table, pos[c][KNIGHT], black, sq, k[0], k[1], 0);
+        cuckoo_add_direction(table, pos[c][KING], black, sq, r[0], r[1], 0);
+        cuckoo_add_direction(table, pos[c][QUEEN], black, sq, r[0], r[1], 1);
+        if (d < 4)
+          cuckoo_add_direction(table, pos[c][ROOK], black, sq, r[0], r[1], 1);
+        else
+          cuckoo_add_direction(table, pos[c][BISHOP], black, sq, r[0], r[1],
+                               1);
+      }
+    }
+  }
+
+  printf("#define CUCKOO_H1(key) ((key)&0x1FFF)\n");
+  printf("#define CUCKOO_H2(key) (((key) >> 16) & 0x1FFF)\n");
+
+  uint64_t keys[CUCKOO_SIZE];
+  uint64_t between[CUCKOO_SIZE];
+  uint64_t squares[CUCKOO_SIZE];
+  for (int i = 0; i < CUCKOO_SIZE; i++) {
+    keys[i] = table[i].key;
+    between[i] = table[i].between;
+    squares[i] = table[i].squares;
+  }
+
+  printf("const uint64_t cuckoo_keys[%d] = {\n", CUCKOO_SIZE);
+  print_keys(keys, CUCKOO_SIZE);
+  printf("};\n");
+
+  // The squares in between which need to be empty for the move to be possible,
+  // and the two squares it moves between.
+  printf("const uint64_t cuckoo_between[%d] = {\n", CUCKOO_SIZE);
+  print_keys(between, CUCKOO_SIZE);
+  printf("};\n");
+
+  printf("const uint64_t cuckoo_squares[%d] = {\n", CUCKOO_SIZE);
+  print_keys(squares, CUCKOO_SIZE);
+  printf("};\n");
+
+  free(table);
+}
+
+void gen_zobrist_keys(void) {
+  // Keys are drawn in the order of the Polyglot book format's Random64 array:
+  // 12 * 64 piece-square keys, then the four castling rights, then the eight
+  // enpassant files, then side to move. They are not Polyglot's keys, though,
+  // and the rules differ too (the side key is for black to move, and any
+  // enpassant square counts), so books go through polyglot_key instead.
+  uint64_t pos[2][6][64];
+  // Polyglot piece order is pawn, knight, bishop, rook, queen, king, with black
+  // before white for each.
+  static const Piecetype polyglot_order[6] = {PAWN, KNIGHT, BISHOP,
+                                              ROOK, QUEEN,  KING};
+  for (int p = 0; p < 6; p++)
+    for (int c = BLACK; c >= WHITE; c--)
+      for (int sq = 0; sq < 64; sq++)
+        pos[c][polyglot_order[p]][sq] = zobrist_rand64();
+
+  uint64_t castle_right[4];
+  for (int i = 0; i < 4; i++)
+    castle_right[i] = zobrist_rand64();
+
+  uint64_t enpassant[8];
+  for (int i = 0; i < 8; i++)
+    enpassant[i] = zobrist_rand64();
+
+  uint64_t black = zobrist_rand64();
+
+  printf("const uint64_t zobrist_pos[2][6][64] = {\n");
+  for (int c = 0; c < 2; c++) {
+    printf("{\n");
+    for (int p = 0; p < 6; p++) {
+      printf("{\n");
+      print_keys(pos[c][p], 64);
+      printf("}%s\n", p < 5 ? "," : "");
+    }
+    printf("}%s\n", c < 1 ? "," : "");
+  }
+  printf("};\n");
+
+  // Each right gets its own key, and a set of rights is the xor of its
+  // members, indexed by State's castle_rights bits.
+  static const uint8_t polyglot_castle_order[4] = {
+      CASTLE_R(CASTLE_R_KS, WHITE), CASTLE_R(CASTLE_R_QS, WHITE),
+      CASTLE_R(CASTLE_R_KS, BLACK), CASTLE_R(CASTLE_R_QS, BLACK)};
+  uint64_t castle[16];
+  for (int rights = 0; rights < 16; rights++) {
+    castle[rights] = 0;
+    for (int i = 0; i < 4; i++)
+      if (rights & polyglot_castle_order[i])
+        castle[rights] ^= castle_right[i];
+  }
+
+  printf("const uint64_t zobrist_castle[16] = {\n");
+  print_keys(castle, 16);
+  printf("};\n");
+
+  printf("const uint64_t zobrist_enpassant[8] = {\n");
+  print_keys(enpassant, 8);
+  printf("};\n");
+
+  printf("const uint64_t zobrist_black = 0x%.16" PRIx64 ";\n", black);
+
+  gen_cuckoo(pos, black);
+}
@@ -0,0 +1,251 @@
+#include <stdint.h>
+
+#include "attackmap.h"
+#include "bitops.h"
+#include "types.h"
+
+// Everything here is done with shifts of whole bitboards: pawn and knight
+// attacks are the piece boards shifted by each offset, and sliders use a
+// Kogge-Stone occluded fill in each of the eight directions. The directions
+// come in two groups of four, the ones which shift left (up the board) and the
+// ones which shift right, and each group goes through the same sequence of
+// operations, so with SIMD all four lanes are done at once.
+#if __AVX2__
+#include <immintrin.h>
+#define ATTACKMAP_AVX 1
+#elif __ARM_NEON
+#include <arm_neon.h>
+#define ATTACKMAP_NEON 1
+#endif
+
+#define COL_A 0x0101010101010101ULL
+#define COL_B 0x0202020202020202ULL
+#define COL_G 0x4040404040404040ULL
+#define COL_H 0x8080808080808080ULL
+
+#if ATTACKMAP_AVX
+typedef __m256i Lanes;
+
+static inline Lanes lanes_set(uint64_t a, uint64_t b, uint64_t c, uint64_t d) {
+  return _mm256_set_epi64x((long long)d, (long long)c, (long long)b,
+                           (long long)a);
+}
+
+static inline Lanes lanes_and(Lanes a, Lanes b) {
+  return _mm256_and_si256(a, b);
+}
+
+static inline Lanes lanes_or(Lanes a, Lanes b) {
+  return _mm256_or_si256(a, b);
+}
+
+static inline Lanes lanes_shl(Lanes a, Lanes shift) {
+  return _mm256_sllv_epi64(a, shift);
+}
+
+static inline Lanes lanes_shr(Lanes a, Lanes shift) {
+  return _mm256_srlv_epi64(a, shift);
+}
+
+static inline void lanes_get(Lanes a, uint64_t out[4]) {
+  _mm256_storeu_si256((__m256i*)out, a);
+}
+#elif ATTACKMAP_NEON
+typedef struct {
+  uint64x2_t lo;
+  uint64x2_t hi;
+} Lanes;
+
+static inline Lanes lanes_set(uint64_t a, uint64_t b, uint64_t c, uint64_t d) {
+  Lanes result = {vcombine_u64(vcreate_u64(a), vcreate_u64(b)),
+                  vcombine_u64(vcreate_u64(c), vcreate_u64(d))};
+  return result;
+}
+
+static inline Lanes lanes_and(Lanes a, Lanes b) {
+  Lanes result = {vandq_u64(a.lo, b.lo), vandq_u64(a.hi, b.hi)};
+  return result;
+}
+
+static inline Lanes lanes_or(Lanes a, Lanes b) {
+  Lanes result = {vorrq_u64(a.lo, b.lo), vorrq_u64(a.hi, b.hi)};
+  return result;
+}
+
+// NEON only has a left shift by a per-lane amount, which shifts right when the
+// amount is negative.
+static inline Lanes lanes_shl(Lanes a, Lanes shift) {
+  Lanes result = {vshlq_u64(a.lo, vreinterpretq_s64_u64(shift.lo)),
+                  vshlq_u64(a.hi, vreinterpretq_s64_u64(shift.hi))};
+  return result;
+}
+
+static inline Lanes lanes_shr(Lanes a, Lanes shift) {
+  Lanes result = {
+      vshlq_u64(a.lo, vnegq_s64(vreinterpretq_s64_u64(shift.lo))),
+      vshlq_u64(a.hi, vnegq_s64(vreinterpretq_s64_u64(shift.hi)))};
+  return result;
+}
+
+static inline void lanes_get(Lanes a, uint64_t out[4]) {
+  vst1q_u64(out, a.lo);
+  vst1q_u64(out + 2, a.hi);
+}
+#else
+typedef struct {
+  uint64_t v[4];
+} Lanes;
+
+static inline Lanes lanes_set(uint64_t a, uint64_t b, uint64_t c, uint64_t d) {
+  Lanes result = {{a, b, c, d}};
+  return result;
+}
+
+static inline Lanes lanes_and(Lanes a, Lanes b) {
+  for (int i = 0; i < 4; i++)
+    a.v[i] &= b.v[i];
+  return a;
+}
+
+static inline Lanes lanes_or(Lanes a, Lanes b) {
+  for (int i = 0; i < 4; i++)
+    a.v[i] |= b.v[i];
+  return a;
+}
+
+static inline Lanes lanes_shl(Lanes a, Lanes shift) {
+  for (int i = 0; i < 4; i++)
+    a.v[i] <<= shift.v[i];
+  return a;
+}
+
+static inline Lanes lanes_shr(Lanes a, Lanes shift) {
+  for (int i = 0; i < 4; i++)
+    a.v[i] >>= shift.v[i];
+  return a;
+}
+
+static inline void lanes_get(Lanes a, uint64_t out[4]) {
+  for (int i = 0; i < 4; i++)
+    out[i] = a.v[i];
+}
+#endif
+
+// Squares attacked by the pieces in gen, sliding in each lane's direction
+// (given by shift, with wrap masking off whatever falls off the side of the
+// board) until they hit something in occ.
+static inline Lanes attackmap_fill_left(Lanes gen,
+                                        Lanes shift,
+                                        Lanes wrap,
+                                        uint64_t occ) {
+  Lanes pro = lanes_and(lanes_set(~occ, ~occ, ~occ, ~occ), wrap);
+  gen = lanes_or(gen, lanes_and(pro, lanes_shl(gen, shift)));
+  pro = lanes_and(pro, lanes_shl(pro, shift));
+  shift = lanes_shl(shift, lanes_set(1, 1, 1, 1));
+  gen = lanes_or(gen, lanes_and(pro, lanes_shl(gen, shift)));
+  pro = lanes_and(pro, lanes_shl(pro, shift));
+  shift = lanes_shl(shift, lanes_set(1, 1, 1, 1));
+  gen = lanes_or(gen, lanes_and(pro, lanes_shl(gen, shift)));
+  shift = lanes_shr(shift, lanes_set(2, 2, 2, 2));
+  return lanes_and(lanes_shl(gen, shift), wrap);
+}
+
+static inline Lanes attackmap_fill_right(Lanes gen,
+                                         Lanes shift,
+                                         Lanes wrap,
+                                         uint64_t occ) {
+  Lanes pro = lanes_and(lanes_set(~occ, ~occ, ~occ, ~occ), wrap);
+  gen = lanes_or(gen, lanes_and(pro, lanes_shr(gen, shift)));
+  pro = lanes_and(pro, lanes_shr(pro, shift));
+  shift = lanes_shl(shift, lanes_set(1, 1, 1, 1));
+  gen = lanes_or(gen, lanes_and(pro, lanes_shr(gen, shift)));
+  pro = lanes_and(pro, lanes_shr(pro, shift));
+  shift = lanes_shl(shift, lanes_set(1, 1, 1, 1));
+  gen = lanes_or(gen, lanes_and(pro, lanes_shr(gen, shift)));
+  shift = lanes_shr(shift, lanes_set(2, 2, 2, 2));
+  return lanes_and(lanes_shr(gen, shift), wrap);
+}
+
+// Add in a set of attacks where no square can be attacked twice, i.e., the
+// attacks of a set of pieces all going the same direction.
+static inline void attackmap_add(uint64_t* attacked,
+                                 uint64_t* twice,
+                                 uint64_t attacks) {
+  *twice |= *attacked & attacks;
+  *attacked |= attacks;
+}
+
+static inline void attackmap_add_lanes(uint64_t* attacked,
+                                       uint64_t* twice,
+                                       Lanes attacks) {
+  uint64_t lanes[4];
+  lanes_get(attacks, lanes);
+  for (int i = 0; i < 4; i++)
+    attackmap_add(attacked, twice, lanes[i]);
+}
+
+void attackmap_generate(const Bitboard* board, AttackMap* map) {
+  // Left shifts are up, right, up-right and up-left (and down, left, down-left
+  // and down-right for the same amounts to the right). Every shift which
+  // moves a column needs to mask off whatever wrapped around to the other side
+  // of the board.
+  const Lanes slide_shift = lanes_set(8, 1, 9, 7);
+  const Lanes slide_wrap_left = lanes_set(~0ULL, ~COL_A, ~COL_A, ~COL_H);
+  const Lanes slide_wrap_right = lanes_set(~0ULL, ~COL_H, ~COL_H, ~COL_A);
+
+  const Lanes knight_shift = lanes_set(17, 15, 10, 6);
+  const Lanes knight_wrap_left =
+      lanes_set(~COL_A, ~COL_H, ~(COL_A | COL_B), ~(COL_G | COL_H));
+  const Lanes knight_wrap_right =
+      lanes_set(~COL_H, ~COL_A, ~(COL_G | COL_H), ~(COL_A | COL_B));
+
+  uint64_t occ = board->full_composite;
+
+  for (Color c = WHITE; c <= BLACK; c++) {
+    uint64_t attacked = 0;
+    uint64_t twice = 0;
+
+    uint64_t pawns = board->boards[c][PAWN];
+    if (c == WHITE) {
+      attackmap_add(&attacked, &twice, (pawns & ~COL_A) << 7);
+      attackmap_add(&attacked, &twice, (pawns & ~COL_H) << 9);
+    } else {
+      attackmap_add(&attacked, &twice, (pawns & ~COL_A) >> 9);
+      attackmap_add(&attacked, &twice, (pawns & ~COL_H) >> 7);
+    }
+
+    uint64_t n = board->boards[c][KNIGHT];
+    Lanes knights = lanes_set(n, n, n, n);
+    attackmap_add_lanes(
+        &attacked, &twice,
+        lanes_and(lanes_shl(knights, knight_shift), knight_wrap_left));
+    attackmap_add_lanes(
+        &attacked, &twice,
+        lanes_and(lanes_shr(knights, knight_shift), knight_wrap_right));
+
+    uint64_t rq = board->boards[c][ROOK] | board->boards[c][QUEEN];
+    uint64_t bq = board->boards[c][BISHOP] | board->boards[c][QUEEN];
+    Lanes sliders = lanes_set(rq, rq, bq, bq);
+    attackmap_add_lanes(
+        &attacked, &twice,
+        attackmap_fill_left(sliders, slide_shift, slide_wrap_left, occ));
+    attackmap_add_lanes(
+        &attacked, &twice,
+        attackmap_fill_right(sliders, slide_shift, slide_wrap_right, occ));
+
+    // There's only one king, so it never attacks anything twice by itself.
+    uint64_t k = board->boards[c][KING];
+    Lanes king = lanes_set(k, k, k, k);
+    uint64_t king_lanes[4];
+    lanes_get(lanes_or(lanes_and(lanes_shl(king, slide_shift), slide_wrap_left),
+                       lanes_and(lanes_shr(king, slide_shift),
+                                 slide_wrap_right)),
+              king_lanes);
+    attackmap_add(&attacked, &twice,
+                  king_lanes[0] | king_lanes[1] | king_lanes[2] |
+                      king_lanes[3]);
+
+    map->attacked[c] = attacked;
+    map->attacked_twice[c] = twice;
+  }
+}
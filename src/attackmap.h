@@ -0,0 +1,21 @@
+#ifndef _ATTACKMAP_H
+#define _ATTACKMAP_H
+
+#include <stdint.h>
+
+#include "types.h"
+
+typedef struct {
+  // Every square attacked by each color, and the squares attacked at least
+  // twice. Sliders attack up to and including the first piece in the way, with
+  // no x-rays, and the squares a king or pawn attacks count whether or not
+  // moving there would be legal.
+  uint64_t attacked[2];
+  uint64_t attacked_twice[2];
+} AttackMap;
+
+// Work out the attacks of every piece on the board at once, rather than
+// square by square with move_generate_attackers.
+void attackmap_generate(const Bitboard* board, AttackMap* map);
+
+#endif
@@ -0,0 +1,604 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bitbase.h"
+#include "bitboard.h"
+#include "bitops.h"
+#include "move.h"
+#include "types.h"
+
+#define BITBASE_MAX_TABLES 32
+#define BITBASE_MAX_THREADS 64
+#define BITBASE_CHUNK 4096
+
+#define BITBASE_FILE_MAGIC 0x45534142544942ULL  // "BITBASE"
+#define BITBASE_FILE_VERSION 1
+
+// Packed value for positions which can't occur (e.g., the side not to move is
+// in check.)
+#define BITBASE_INVALID 3
+
+// While generating, each position gets a byte. WIN, LOSS and INVALID match the
+// packed values; DRAW is only known for stalemates, anything still UNKNOWN once
+// the generation stops making progress is also a draw.
+#define GEN_UNKNOWN 0
+#define GEN_WIN BITBASE_WIN
+#define GEN_LOSS BITBASE_LOSS
+#define GEN_INVALID BITBASE_INVALID
+#define GEN_DRAW 4
+
+// Tables are found by the board's material key.
+#define BITBASE_KEY_COLOR_MASK 0xFFFFFFULL
+#define BITBASE_KEY_KINGS \
+  (MATERIAL_KEY(WHITE, KING) + MATERIAL_KEY(BLACK, KING))
+
+typedef struct {
+  char name[BITBASE_MAX_PIECES + 1];
+
+  // Every piece gets a slot. Kings first, and then in the order they appear in
+  // the name.
+  uint8_t n;
+  Color colors[BITBASE_MAX_PIECES];
+  Piecetype pieces[BITBASE_MAX_PIECES];
+
+  uint64_t key;
+  uint64_t flipped_key;
+
+  // Positions are indexed by side to move and the square of each slot.
+  uint32_t size;
+  uint8_t* data;
+} Bitbase;
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t size;
+  uint64_t key;
+} BitbaseFileHeader;
+
+typedef struct {
+  const Bitbase* table;
+  uint8_t* values;
+
+  // Bitmaps of positions to look at in this sweep (NULL for all of them), and
+  // positions to look at in the next.
+  const uint8_t* dirty;
+  uint8_t* next_dirty;
+
+  uint32_t next_chunk;
+  int changed;
+} BitbaseWork;
+
+static const char piece_chars[] = "PBNRQK";
+static const Piecetype name_order[] = {KING, QUEEN, ROOK, BISHOP, KNIGHT, PAWN};
+static const int piece_values[] = {1, 3, 3, 5, 9, 0};
+
+static Bitbase tables[BITBASE_MAX_TABLES];
+static int num_tables = 0;
+
+static unsigned bitbase_key_count(uint64_t key, Color color, Piecetype piece) {
+  return (unsigned)MATERIAL_COUNT(key, color, piece);
+}
+
+static uint64_t bitbase_flip_key(uint64_t key) {
+  return (key >> 24) | ((key & BITBASE_KEY_COLOR_MASK) << 24);
+}
+
+// Positions which can't be won by either side, so never need a table.
+static int bitbase_is_dead_draw(uint64_t key) {
+  uint64_t pieces = key - BITBASE_KEY_KINGS;
+  return pieces == 0 || pieces == MATERIAL_KEY(WHITE, BISHOP) ||
+         pieces == MATERIAL_KEY(WHITE, KNIGHT) ||
+         pieces == MATERIAL_KEY(BLACK, BISHOP) ||
+         pieces == MATERIAL_KEY(BLACK, KNIGHT);
+}
+
+// Can we build a table for this material?
+static int bitbase_is_supported(uint64_t key) {
+  unsigned n = 0;
+  for (Color c = WHITE; c <= BLACK; c++) {
+    if (bitbase_key_count(key, c, KING) != 1)
+      return 0;
+    for (Piecetype p = PAWN; p < KING; p++) {
+      unsigned count = bitbase_key_count(key, c, p);
+      if (count > 1)
+        return 0;
+      n += count;
+    }
+  }
+
+  if (bitbase_key_count(key, WHITE, PAWN) &&
+      bitbase_key_count(key, BLACK, PAWN))
+    return 0;
+
+  return n + 2 <= BITBASE_MAX_PIECES;
+}
+
+static int bitbase_side_value(uint64_t key, Color color) {
+  int value = 0;
+  for (Piecetype p = PAWN; p < KING; p++)
+    value += piece_values[p] * (int)bitbase_key_count(key, color, p);
+  return value;
+}
+
+// Tables are kept with the stronger side as white.
+static uint64_t bitbase_canonical_key(uint64_t key) {
+  uint64_t flipped = bitbase_flip_key(key);
+  int white = bitbase_side_value(key, WHITE);
+  int black = bitbase_side_value(key, BLACK);
+
+  if (white < black ||
+      (white == black && (key & BITBASE_KEY_COLOR_MASK) <
+                             (flipped & BITBASE_KEY_COLOR_MASK)))
+    return flipped;
+  return key;
+}
+
+static int bitbase_parse(const char* material, uint64_t* key) {
+  Color c = WHITE;
+  int kings = 0;
+
+  *key = 0;
+  for (const char* s = material; *s; s++) {
+    const char* p = strchr(piece_chars, *s);
+    if (!p)
+      return -1;
+
+    Piecetype piece = (Piecetype)(p - piece_chars);
+    if (piece == KING && ++kings == 2)
+      c = BLACK;
+    if (kings == 0 || bitbase_key_count(*key, c, piece) == 0xF)
+      return -1;
+
+    *key += MATERIAL_KEY(c, piece);
+  }
+
+  return bitbase_is_supported(*key) ? 0 : -1;
+}
+
+static void bitbase_from_key(Bitbase* t, uint64_t key) {
+  memset(t, 0, sizeof(*t));
+  t->key = key;
+  t->flipped_key = bitbase_flip_key(key);
+
+  for (Color c = WHITE; c <= BLACK; c++) {
+    for (size_t i = 0; i < sizeof(name_order) / sizeof(name_order[0]); i++) {
+      Piecetype p = name_order[i];
+      if (bitbase_key_count(key, c, p) == 0)
+        continue;
+
+      t->name[t->n] = piece_chars[p];
+      t->colors[t->n] = c;
+      t->pieces[t->n] = p;
+      t->n++;
+    }
+  }
+
+  t->size = 2U << (6 * t->n);
+}
+
+static const Bitbase* bitbase_find(uint64_t key, int* flip) {
+  for (int i = 0; i < num_tables; i++) {
+    if (tables[i].key == key) {
+      *flip = 0;
+      return &tables[i];
+    }
+    if (tables[i].flipped_key == key) {
+      *flip = 1;
+      return &tables[i];
+    }
+  }
+  return NULL;
+}
+
+// When flip is set, the board has the colors the other way around from the
+// table, so we mirror it vertically and swap the colors.
+static uint32_t bitbase_index(const Bitbase* t,
+                              const Bitboard* board,
+                              int flip) {
+  uint32_t index = 0;
+  for (int i = t->n - 1; i >= 0; i--) {
+    Color c = flip ? !t->colors[i] : t->colors[i];
+    uint8_t square = bitscan(board->boards[c][t->pieces[i]]);
+    index = index * 64 + (flip ? square ^ 56 : square);
+  }
+  return index * 2 + (flip ? !board->to_move : board->to_move);
+}
+
+static uint8_t bitbase_get(const Bitbase* t, uint32_t index) {
+  return (t->data[index / 4] >> (2 * (index % 4))) & 3;
+}
+
+// Returns 0 if the index isn't a legal position.
+static int bitbase_setup(const Bitbase* t,
+                         uint32_t index,
+                         Bitboard* board,
+                         State* state) {
+  uint64_t boards[2][6] = {{0}};
+  uint64_t occupied = 0;
+  Color to_move = index & 1;
+
+  index >>= 1;
+  for (int i = 0; i < t->n; i++, index >>= 6) {
+    uint8_t square = index & 63;
+    uint64_t bit = 1ULL << square;
+    if (occupied & bit)
+      return 0;
+    if (t->pieces[i] == PAWN &&
+        (board_row_of(square) == 0 || board_row_of(square) == 7))
+      return 0;
+
+    occupied |= bit;
+    boards[t->colors[i]][t->pieces[i]] |= bit;
+  }
+
+  board_init_with_boards(board, state, boards, to_move);
+  return !board_in_check(board, !to_move);
+}
+
+// The value for the side to move of a position reached while generating t.
+static uint8_t bitbase_gen_successor(const Bitbase* t,
+                                     const uint8_t* values,
+                                     const Bitboard* board) {
+  uint64_t key = board->state->material_key;
+  if (key == t->key)
+    return __atomic_load_n(&values[bitbase_index(t, board, 0)],
+                           __ATOMIC_RELAXED);
+  if (key == t->flipped_key)
+    return __atomic_load_n(&values[bitbase_index(t, board, 1)],
+                           __ATOMIC_RELAXED);
+
+  int flip;
+  const Bitbase* other = bitbase_find(key, &flip);
+  if (!other) {
+    // Anything else was generated before we started.
+    assert(bitbase_is_dead_draw(key));
+    return GEN_DRAW;
+  }
+
+  uint8_t value = bitbase_get(other, bitbase_index(other, board, flip));
+  return value == BITBASE_DRAW ? GEN_DRAW : value;
+}
+
+static uint8_t bitbase_gen_value(const Bitbase* t,
+                                 const uint8_t* values,
+                                 Bitboard* board) {
+  Movelist moves;
+  int legal_moves = 0;
+  int all_lose = 1;
+
+  move_generate_movelist(board, &moves, MOVE_GEN_ALL);
+  for (int i = 0; i < moves.n; i++) {
+    Move m = moves.moves[i];
+    if (!move_is_legal(board, m))
+      continue;
+
+    State s;
+    board_do_move(board, m, &s);
+    uint8_t value = bitbase_gen_successor(t, values, board);
+    board_undo_move(board);
+
+    if (value == GEN_LOSS)
+      return GEN_WIN;
+    if (value != GEN_WIN)
+      all_lose = 0;
+    legal_moves++;
+  }
+
+  if (legal_moves == 0)
+    return board_in_check(board, board->to_move) ? GEN_LOSS : GEN_DRAW;
+  return all_lose ? GEN_LOSS : GEN_UNKNOWN;
+}
+
+// Where could a pawn on square have been pushed from?
+static uint64_t bitbase_pawn_sources(uint8_t square,
+                                     Color color,
+                                     uint64_t occupied) {
+  int8_t dir = color == WHITE ? -8 : 8;
+  uint8_t row = board_row_of(square);
+  uint8_t one = (uint8_t)(square + dir);
+  uint64_t sources = 0;
+
+  if ((color == WHITE ? row < 2 : row > 5) || (occupied & (1ULL << one)))
+    return 0;
+  sources |= 1ULL << one;
+
+  uint8_t two = (uint8_t)(one + dir);
+  if (row == (color == WHITE ? 3 : 4) && !(occupied & (1ULL << two)))
+    sources |= 1ULL << two;
+
+  return sources;
+}
+
+// Flag every position in t which can reach this one by a move that doesn't
+// change the material, since its value might now be known too.
+static void bitbase_mark_predecessors(const Bitbase* t,
+                                      uint32_t index,
+                                      const Bitboard* board,
+                                      uint8_t* dirty) {
+  Color moved = !board->to_move;
+  uint32_t squares = index >> 1;
+
+  for (int i = 0; i < t->n; i++) {
+    if (t->colors[i] != moved)
+      continue;
+
+    uint8_t square = (squares >> (6 * i)) & 63;
+    uint64_t sources =
+        t->pieces[i] == PAWN
+            ? bitbase_pawn_sources(square, moved, board->full_composite)
+            : move_generate_attacks(board, t->pieces[i], moved, square) &
+                  ~board->full_composite;
+
+    while (sources) {
+      uint32_t source = bitscan(sources);
+      sources &= sources - 1;
+
+      uint32_t pred = (squares & ~(63U << (6 * i))) | (source << (6 * i));
+      pred = pred * 2 + moved;
+      __atomic_fetch_or(&dirty[pred / 8], (uint8_t)(1 << (pred % 8)),
+                        __ATOMIC_RELAXED);
+    }
+  }
+}
+
+static void* bitbase_gen_thread(void* arg) {
+  BitbaseWork* work = arg;
+  const Bitbase* t = work->table;
+  Bitboard board;
+  State state;
+  int changed = 0;
+
+  for (;;) {
+    uint32_t begin = BITBASE_CHUNK * __atomic_fetch_add(&work->next_chunk, 1,
+                                                        __ATOMIC_RELAXED);
+    if (begin >= t->size)
+      break;
+    uint32_t end = begin + BITBASE_CHUNK < t->size ? begin + BITBASE_CHUNK
+                                                   : t->size;
+
+    for (uint32_t index = begin; index < end; index++) {
+      if (work->dirty && !(work->dirty[index / 8] & (1 << (index % 8))))
+        continue;
+      if (__atomic_load_n(&work->values[index], __ATOMIC_RELAXED) !=
+          GEN_UNKNOWN)
+        continue;
+
+      if (!bitbase_setup(t, index, &board, &state)) {
+        __atomic_store_n(&work->values[index], GEN_INVALID, __ATOMIC_RELAXED);
+        continue;
+      }
+
+      uint8_t value = bitbase_gen_value(t, work->values, &board);
+      if (value == GEN_UNKNOWN)
+        continue;
+
+      __atomic_store_n(&work->values[index], value, __ATOMIC_RELAXED);
+      if (value != GEN_DRAW)
+        bitbase_mark_predecessors(t, index, &board, work->next_dirty);
+      changed = 1;
+    }
+  }
+
+  if (changed)
+    __atomic_store_n(&work->changed, 1, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+// The first sweep looks at every position. After that, we only need to look at
+// positions which have a move to one that was decided in the previous sweep;
+// keep going until a sweep decides nothing new. Sweeps are split between
+// threads. A thread can see values written by others during the same sweep,
+// which only speeds things up.
+static int bitbase_build(Bitbase* t) {
+  uint8_t* values = calloc(t->size, 1);
+  uint8_t* dirty = calloc(t->size / 8, 1);
+  uint8_t* next_dirty = calloc(t->size / 8, 1);
+  t->data = calloc(t->size / 4, 1);
+  if (!values || !dirty || !next_dirty || !t->data) {
+    free(values);
+    free(dirty);
+    free(next_dirty);
+    free(t->data);
+    t->data = NULL;
+    return -1;
+  }
+
+  long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthreads < 1)
+    nthreads = 1;
+  if (nthreads > BITBASE_MAX_THREADS)
+    nthreads = BITBASE_MAX_THREADS;
+
+  BitbaseWork work = {.table = t, .values = values, .changed = 1};
+  while (work.changed) {
+    pthread_t threads[BITBASE_MAX_THREADS];
+    work.next_dirty = next_dirty;
+    work.next_chunk = 0;
+    work.changed = 0;
+
+    long started = 0;
+    while (started < nthreads &&
+           pthread_create(&threads[started], NULL, bitbase_gen_thread,
+                          &work) == 0)
+      started++;
+    if (started == 0)
+      bitbase_gen_thread(&work);
+    for (long i = 0; i < started; i++)
+      pthread_join(threads[i], NULL);
+
+    uint8_t* swap = dirty;
+    dirty = next_dirty;
+    next_dirty = swap;
+    memset(next_dirty, 0, t->size / 8);
+    work.dirty = dirty;
+  }
+
+  for (uint32_t index = 0; index < t->size; index++) {
+    uint8_t value = values[index];
+    if (value == GEN_UNKNOWN || value == GEN_DRAW)
+      value = BITBASE_DRAW;
+    t->data[index / 4] |= (uint8_t)(value << (2 * (index % 4)));
+  }
+
+  free(values);
+  free(dirty);
+  free(next_dirty);
+  return 0;
+}
+
+static int bitbase_filename(const Bitbase* t,
+                            const char* cache_dir,
+                            char* filename,
+                            size_t len) {
+  return snprintf(filename, len, "%s/%s.bitbase", cache_dir, t->name) <
+                 (int)len
+             ? 0
+             : -1;
+}
+
+static int bitbase_load(Bitbase* t, const char* cache_dir) {
+  char filename[1024];
+  if (bitbase_filename(t, cache_dir, filename, sizeof(filename)) != 0)
+    return -1;
+
+  FILE* f = fopen(filename, "rb");
+  if (!f)
+    return -1;
+
+  BitbaseFileHeader h;
+  t->data = malloc(t->size / 4);
+  if (!t->data || fread(&h, sizeof(h), 1, f) != 1 ||
+      h.magic != BITBASE_FILE_MAGIC || h.version != BITBASE_FILE_VERSION ||
+      h.size != t->size || h.key != t->key ||
+      fread(t->data, t->size / 4, 1, f) != 1) {
+    fprintf(stderr, "Ignoring bad bitbase %s\n", filename);
+    free(t->data);
+    t->data = NULL;
+    fclose(f);
+    return -1;
+  }
+
+  fclose(f);
+  return 0;
+}
+
+static void bitbase_save(const Bitbase* t, const char* cache_dir) {
+  char filename[1024];
+  char tmp_filename[1040];
+  if (bitbase_filename(t, cache_dir, filename, sizeof(filename)) != 0)
+    return;
+  snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+
+  FILE* f = fopen(tmp_filename, "wb");
+  if (!f) {
+    perror("Failed to save bitbase");
+    return;
+  }
+
+  BitbaseFileHeader h = {.magic = BITBASE_FILE_MAGIC,
+                         .version = BITBASE_FILE_VERSION,
+                         .size = t->size,
+                         .key = t->key};
+  if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+      fwrite(t->data, t->size / 4, 1, f) != 1 || fclose(f) != 0 ||
+      rename(tmp_filename, filename) != 0) {
+    perror("Failed to save bitbase");
+    unlink(tmp_filename);
+  }
+}
+
+static int bitbase_generate_key(uint64_t key, const char* cache_dir) {
+  int flip;
+  if (bitbase_is_dead_draw(key) || bitbase_find(key, &flip))
+    return 0;
+
+  if (!bitbase_is_supported(key)) {
+    fprintf(stderr, "Unsupported bitbase material\n");
+    return -1;
+  }
+
+  // Everything a capture or promotion can lead to has to be done first.
+  for (Color c = WHITE; c <= BLACK; c++) {
+    for (Piecetype p = PAWN; p < KING; p++) {
+      if (bitbase_key_count(key, c, p) == 0)
+        continue;
+
+      uint64_t captured = key - MATERIAL_KEY(c, p);
+      if (bitbase_generate_key(bitbase_canonical_key(captured), cache_dir))
+        return -1;
+
+      if (p != PAWN)
+        continue;
+      for (Piecetype promoted = BISHOP; promoted <= QUEEN; promoted++) {
+        uint64_t promotion = captured + MATERIAL_KEY(c, promoted);
+        if (bitbase_generate_key(bitbase_canonical_key(promotion), cache_dir))
+          return -1;
+      }
+    }
+  }
+
+  if (num_tables == BITBASE_MAX_TABLES) {
+    fprintf(stderr, "Too many bitbases\n");
+    return -1;
+  }
+
+  // Only count the table once it's complete, since it's visible to probes.
+  Bitbase* t = &tables[num_tables];
+  bitbase_from_key(t, key);
+  if (cache_dir && bitbase_load(t, cache_dir) == 0) {
+    num_tables++;
+    return 0;
+  }
+
+  if (bitbase_build(t) != 0) {
+    fprintf(stderr, "Failed to allocate bitbase %s\n", t->name);
+    return -1;
+  }
+  if (cache_dir)
+    bitbase_save(t, cache_dir);
+
+  num_tables++;
+  return 0;
+}
+
+int bitbase_generate(const char* material, const char* cache_dir) {
+  uint64_t key;
+  if (bitbase_parse(material, &key) != 0) {
+    fprintf(stderr, "Unsupported bitbase material %s\n", material);
+    return -1;
+  }
+
+  return bitbase_generate_key(bitbase_canonical_key(key), cache_dir);
+}
+
+int bitbase_init(const char* cache_dir) {
+  static const char* standard[] = {"KPK", "KRK", "KQK", "KBNK", "KRKP"};
+  for (size_t i = 0; i < sizeof(standard) / sizeof(standard[0]); i++) {
+    if (bitbase_generate(standard[i], cache_dir) != 0)
+      return -1;
+  }
+  return 0;
+}
+
+int bitbase_probe(const Bitboard* board, int* result) {
+  if (num_tables == 0 || popcnt(board->full_composite) > BITBASE_MAX_PIECES ||
+      board->state->castle_rights != 0)
+    return 0;
+
+  int flip;
+  const Bitbase* t = bitbase_find(board->state->material_key, &flip);
+  if (!t)
+    return 0;
+
+  uint8_t value = bitbase_get(t, bitbase_index(t, board, flip));
+  if (value == BITBASE_INVALID)
+    return 0;
+
+  *result = value;
+  return 1;
+}
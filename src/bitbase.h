@@ -0,0 +1,27 @@
+#ifndef _BITBASE_H
+#define _BITBASE_H
+
+#include "types.h"
+
+#define BITBASE_MAX_PIECES 4
+
+// Probe results, relative to the side to move.
+#define BITBASE_DRAW 0
+#define BITBASE_WIN 1
+#define BITBASE_LOSS 2
+
+// Build the bitbase for material, written as white's pieces and then black's,
+// each starting with the king (e.g., "KRKP"), along with all of the bitbases it
+// can turn into by capture or promotion. If cache_dir is not NULL, tables are
+// loaded from there if they have previously been built, and saved there if not.
+// Up to BITBASE_MAX_PIECES pieces; no duplicate pieces, and no pawns on both
+// sides. Returns 0 on success.
+int bitbase_generate(const char* material, const char* cache_dir);
+
+// Build the standard set of bitbases: KPK, KRK, KQK, KBNK, KRKP.
+int bitbase_init(const char* cache_dir);
+
+// If we have a bitbase for the position, return 1 and fill in result.
+int bitbase_probe(const Bitboard* board, int* result);
+
+#endif
@@ -7,30 +7,38 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../gen/zobrist.h"
 #include "bitboard.h"
 #include "bitops.h"
 #include "config.h"
+#include "evaluate.h"
 #include "move.h"
-#include "mt19937.h"
 #include "nnue.h"
 
-// generate a 64-bit random number
-static inline uint64_t board_rand64(void);
+// set up everything derived from the piece boards, to_move, and the
+// castle/enpassant/halfmove state
+static void board_init_finish(Bitboard* board);
 
-// generate a bunch of random numbers to put in for zobrists
-static void board_init_zobrist(Bitboard* board);
+// compute the zobrist of the board from scratch
+static uint64_t board_compute_zobrist(const Bitboard* board);
+static uint64_t board_compute_pawn_zobrist(const Bitboard* board);
+static uint64_t board_compute_material_key(const Bitboard* board);
 
 // common bits of making and undoing moves that can be easily factored out
 static void board_doundo_move_common(Bitboard* board,
                                      Move move,
                                      int nnue_activate);
-static void board_toggle_piece(Bitboard* board,
-                               Piecetype piece,
-                               Color color,
-                               uint8_t loc,
-                               int nnue_activate);
+ALWAYS_INLINE void board_doundo_move_color(Bitboard* board,
+                                           Move move,
+                                           int nnue_activate,
+                                           Color color);
+ALWAYS_INLINE void board_toggle_piece(Bitboard* board,
+                                      Piecetype piece,
+                                      Color color,
+                                      uint8_t loc,
+                                      int nnue_activate);
+static uint8_t board_castle_rights_after(uint8_t castle_rights, Move move);
 static uint64_t board_gen_king_attackers(const Bitboard* board, Color color);
-static void board_update_expensive_state(Bitboard* board);
 
 static char board_sigil(int color, Piecetype type);
 
@@ -110,17 +118,6 @@ void board_init_with_fen(Bitboard* board, State* state, const char* fen) {
     row++;  // next row
   }
 
-  // calculate the composite and rotated boards
-  for (Color c = WHITE; c <= BLACK; c++) {
-    board->composite_boards[c] = 0;
-    for (Piecetype p = PAWN; p <= KING; p++) {
-      board->composite_boards[c] |= board->boards[c][p];
-    }
-  }
-
-  board->full_composite =
-      board->composite_boards[WHITE] | board->composite_boards[BLACK];
-
   // w or b to move
   board->to_move = (*fen == 'w' ? WHITE : BLACK);
   fen += 2;  // skip the w or b and then the space
@@ -178,43 +175,110 @@ void board_init_with_fen(Bitboard* board, State* state, const char* fen) {
      with any used zobrist */
   board->state->halfmove_count = (uint8_t)strtol(fen, NULL, 10);
 
-  // set up the mess of zobrist random numbers and the rest of the state
-  board_init_zobrist(board);
+  board_init_finish(board);
+}
+
+void board_init_with_boards(Bitboard* board,
+                            State* state,
+                            uint64_t boards[2][6],
+                            Color to_move) {
+  memcpy(board->boards, boards, 2 * 6 * sizeof(uint64_t));
+  board->state = state;
+  board->to_move = to_move;
+  board->state->castle_rights = 0;
+  board->state->enpassant_index = 0;
+  board->state->halfmove_count = 0;
+
+  board_init_finish(board);
+}
+
+static void board_init_finish(Bitboard* board) {
+  // calculate the composite and rotated boards
+  for (Color c = WHITE; c <= BLACK; c++) {
+    board->composite_boards[c] = 0;
+    for (Piecetype p = PAWN; p <= KING; p++) {
+      board->composite_boards[c] |= board->boards[c][p];
+    }
+  }
+
+  board->full_composite =
+      board->composite_boards[WHITE] | board->composite_boards[BLACK];
+
+  memset(board->squares, NO_PIECE, sizeof(board->squares));
+  for (Color c = WHITE; c <= BLACK; c++) {
+    for (Piecetype p = PAWN; p <= KING; p++) {
+      uint64_t pieces = board->boards[c][p];
+      while (pieces) {
+        board->squares[bitscan(pieces)] = p;
+        pieces &= pieces - 1;
+      }
+    }
+  }
+
+  // set up the zobrist and the rest of the state
+  board->state->zobrist = board_compute_zobrist(board);
+  board->state->pawn_zobrist = board_compute_pawn_zobrist(board);
+  board->state->material_key = board_compute_material_key(board);
   board->state->last_move = MOVE_NULL;
   board->state->prev = NULL;
-  board_update_expensive_state(board);
+  board->state->computed = 0;
   board->generation = 0;
+  evaluate_reset(board);
 
 #if ENABLE_NNUE
   nnue_reset(board);
 #endif
 }
 
-static inline uint64_t board_rand64(void) {
-  // OR two 32-bit randoms together
-  return (((uint64_t)mt_random()) << 32) | ((uint64_t)mt_random());
+static uint64_t board_compute_zobrist(const Bitboard* board) {
+  uint64_t zobrist = 0;
+
+  for (Color c = WHITE; c <= BLACK; c++) {
+    for (Piecetype p = PAWN; p <= KING; p++) {
+      uint64_t pieces = board->boards[c][p];
+      while (pieces) {
+        uint8_t loc = bitscan(pieces);
+        pieces &= pieces - 1;
+        zobrist ^= zobrist_pos[c][p][loc];
+      }
+    }
+  }
+
+  zobrist ^= zobrist_castle[board->state->castle_rights];
+
+  if (board->state->enpassant_index)
+    zobrist ^= zobrist_enpassant[board_col_of(board->state->enpassant_index)];
+
+  if (board->to_move == BLACK)
+    zobrist ^= zobrist_black;
+
+  return zobrist;
 }
 
-static void board_init_zobrist(Bitboard* board) {
-  // initially start with a random zobrist
-  board->state->zobrist = board_rand64();
+static uint64_t board_compute_pawn_zobrist(const Bitboard* board) {
+  uint64_t zobrist = 0;
 
-  // fill in each color/piece/position combination with a random mask
-  for (int i = 0; i < 2; i++)
-    for (int j = 0; j < 6; j++)
-      for (int k = 0; k < 64; k++)
-        board->zobrist_pos[i][j][k] = board_rand64();
+  for (Color c = WHITE; c <= BLACK; c++) {
+    uint64_t pawns = board->boards[c][PAWN];
+    while (pawns) {
+      uint8_t loc = bitscan(pawns);
+      pawns &= pawns - 1;
+      zobrist ^= zobrist_pos[c][PAWN][loc];
+    }
+  }
+
+  return zobrist;
+}
 
-  // same for each castle status ...
-  for (int i = 0; i < 256; i++)
-    board->zobrist_castle[i] = board_rand64();
+static uint64_t board_compute_material_key(const Bitboard* board) {
+  uint64_t key = 0;
 
-  // ... and enpassant index ...
-  for (int i = 0; i < 8; i++)
-    board->zobrist_enpassant[i] = board_rand64();
+  for (Color c = WHITE; c <= BLACK; c++) {
+    for (Piecetype p = PAWN; p <= KING; p++)
+      key += popcnt(board->boards[c][p]) * MATERIAL_KEY(c, p);
+  }
 
-  // ... and to move
-  board->zobrist_black = board_rand64();
+  return key;
 }
 
 void board_do_move(Bitboard* board, Move move, State* state) {
@@ -223,8 +287,9 @@ void board_do_move(Bitboard* board, Move move, State* state) {
       (((1ULL << move_destination_index(move)) & board->full_composite) == 0));
   assert(move_captured_piecetype(move) != KING);
 
-  memcpy(state, board->state, sizeof(State));
+  memcpy(state, board->state, offsetof(State, prev));
   state->prev = board->state;
+  state->computed = 0;
   board->state = state;
 
   board->state->last_move = move;
@@ -236,35 +301,16 @@ void board_do_move(Bitboard* board, Move move, State* state) {
     else
       board->state->halfmove_count++;
 
-    /* moving to or from a rook square means you can no longer castle on
-       that side */
     uint8_t src = move_source_index(move);
     uint8_t dest = move_destination_index(move);
 
     // Once castling rights are gone, you can't get them back, so no need to
     // compute.
     if (board->state->castle_rights) {
-      board->state->zobrist ^=
-          board->zobrist_castle[board->state->castle_rights];
-
-      if (src == 0 || dest == 0)
-        board->state->castle_rights &= ~(CASTLE_R(CASTLE_R_QS, WHITE));
-      if (src == 7 || dest == 7)
-        board->state->castle_rights &= ~(CASTLE_R(CASTLE_R_KS, WHITE));
-      if (src == 56 || dest == 56)
-        board->state->castle_rights &= ~(CASTLE_R(CASTLE_R_QS, BLACK));
-      if (src == 63 || dest == 63)
-        board->state->castle_rights &= ~(CASTLE_R(CASTLE_R_KS, BLACK));
-
-      /* moving your king at all means you can no longer castle on either
-              side. Castling also means you can no longer castle (again) on
-         either side */
-      if (move_is_castle(move) || move_piecetype(move) == KING)
-        board->state->castle_rights &=
-            ~(CASTLE_R(CASTLE_R_BOTH, move_color(move)));
-
-      board->state->zobrist ^=
-          board->zobrist_castle[board->state->castle_rights];
+      board->state->zobrist ^= zobrist_castle[board->state->castle_rights];
+      board->state->castle_rights =
+          board_castle_rights_after(board->state->castle_rights, move);
+      board->state->zobrist ^= zobrist_castle[board->state->castle_rights];
     }
 
     /* if src and dest are 16 or -16 units apart (two rows) on a pawn move,
@@ -272,7 +318,7 @@ void board_do_move(Bitboard* board, Move move, State* state) {
        didn't happen, clear the enpassant index */
     if (board->state->enpassant_index) {
       board->state->zobrist ^=
-          board->zobrist_enpassant[board_col_of(board->state->enpassant_index)];
+          zobrist_enpassant[board_col_of(board->state->enpassant_index)];
     }
     int delta = src - dest;
     if (move_piecetype(move) == PAWN && (delta == 16 || delta == -16))
@@ -281,7 +327,7 @@ void board_do_move(Bitboard* board, Move move, State* state) {
       board->state->enpassant_index = 0;
     if (board->state->enpassant_index) {
       board->state->zobrist ^=
-          board->zobrist_enpassant[board_col_of(board->state->enpassant_index)];
+          zobrist_enpassant[board_col_of(board->state->enpassant_index)];
     }
 
     // common bits of doing and undoing moves (bulk of the logic in here)
@@ -289,17 +335,96 @@ void board_do_move(Bitboard* board, Move move, State* state) {
   } else {
     if (board->state->enpassant_index) {
       board->state->zobrist ^=
-          board->zobrist_enpassant[board_col_of(board->state->enpassant_index)];
+          zobrist_enpassant[board_col_of(board->state->enpassant_index)];
       board->state->enpassant_index = 0;
     }
     board->to_move = (1 - board->to_move);
-    board->state->zobrist ^= board->zobrist_black;
+    board->state->zobrist ^= zobrist_black;
   }
 
   assert(popcnt(board->boards[WHITE][KING]) == 1);
   assert(popcnt(board->boards[BLACK][KING]) == 1);
+}
+
+uint64_t board_zobrist_after_move(const Bitboard* board, Move move) {
+  uint64_t zobrist = board->state->zobrist ^ zobrist_black;
+
+  if (board->state->enpassant_index)
+    zobrist ^= zobrist_enpassant[board_col_of(board->state->enpassant_index)];
+
+  if (move == MOVE_NULL)
+    return zobrist;
+
+  uint8_t src = move_source_index(move);
+  uint8_t dest = move_destination_index(move);
+  Piecetype piece = move_piecetype(move);
+  Color color = move_color(move);
+
+  uint8_t castle_rights = board->state->castle_rights;
+  if (castle_rights) {
+    zobrist ^= zobrist_castle[castle_rights];
+    zobrist ^= zobrist_castle[board_castle_rights_after(castle_rights, move)];
+  }
+
+  int delta = src - dest;
+  if (piece == PAWN && (delta == 16 || delta == -16))
+    zobrist ^= zobrist_enpassant[board_col_of(dest)];
+
+  zobrist ^= zobrist_pos[color][piece][src];
+  if (!move_is_promotion(move))
+    zobrist ^= zobrist_pos[color][piece][dest];
+  else
+    zobrist ^= zobrist_pos[color][move_promoted_piecetype(move)][dest];
+
+  if (move_is_capture(move))
+    zobrist ^= zobrist_pos[1 - color][move_captured_piecetype(move)][dest];
 
-  board_update_expensive_state(board);
+  if (move_is_castle(move)) {
+    if (board_col_of(dest) == 2)  // queenside castle
+      zobrist ^= zobrist_pos[color][ROOK][dest - 2] ^
+                 zobrist_pos[color][ROOK][dest + 1];
+    else  // kingside castle
+      zobrist ^= zobrist_pos[color][ROOK][dest + 1] ^
+                 zobrist_pos[color][ROOK][dest - 1];
+  }
+
+  if (move_is_enpassant(move)) {
+    if (color == WHITE)  // the captured pawn is one row behind
+      zobrist ^= zobrist_pos[BLACK][PAWN][dest - 8];
+    else  // the captured pawn is one row up
+      zobrist ^= zobrist_pos[WHITE][PAWN][dest + 8];
+  }
+
+  return zobrist;
+}
+
+uint64_t board_reversible_move_squares(const Bitboard* board,
+                                       uint64_t zobrist_diff) {
+  size_t i = CUCKOO_H1(zobrist_diff);
+  if (cuckoo_keys[i] != zobrist_diff) {
+    i = CUCKOO_H2(zobrist_diff);
+    if (cuckoo_keys[i] != zobrist_diff)
+      return 0;
+  }
+
+  if (cuckoo_between[i] & board->full_composite)
+    return 0;
+
+  return cuckoo_squares[i];
+}
+
+uint64_t board_zobrist_fingerprint(void) {
+  const uint64_t* tables[] = {&zobrist_pos[0][0][0], zobrist_castle,
+                              zobrist_enpassant, &zobrist_black};
+  const size_t sizes[] = {2 * 6 * 64, 16, 8, 1};
+
+  // Rotate as we go so that the order of the keys matters too.
+  uint64_t fingerprint = 0;
+  for (size_t t = 0; t < 4; t++)
+    for (size_t i = 0; i < sizes[t]; i++)
+      fingerprint = ((fingerprint << 1) | (fingerprint >> 63)) ^ tables[t][i];
+
+  return fingerprint;
 }
 
 void board_undo_move(Bitboard* board) {
@@ -307,26 +432,41 @@ void board_undo_move(Bitboard* board) {
   board->state = board->state->prev;
   assert(board->state);
   uint64_t tmp_zobrist = board->state->zobrist;
+  uint64_t tmp_pawn_zobrist = board->state->pawn_zobrist;
+  uint64_t tmp_material_key = board->state->material_key;
 
   if (move != MOVE_NULL)
     board_doundo_move_common(board, move, -1);
   else
     board->to_move = (1 - board->to_move);
 
-  // By resetting state to prev, we have already restored the zobrist, but
-  // board_doundo_move_common still changes it. So save and restore. (TODO:
-  // should probably fix that for perf!)
+  // By resetting state to prev, we have already restored the zobrists and
+  // material key, but board_doundo_move_common still changes them. So save and
+  // restore. (TODO: should probably fix that for perf!)
   board->state->zobrist = tmp_zobrist;
+  board->state->pawn_zobrist = tmp_pawn_zobrist;
+  board->state->material_key = tmp_material_key;
 }
 
 static void board_doundo_move_common(Bitboard* board,
                                      Move move,
                                      int nnue_activate) {
+  // A copy for each color, so that the board indexes and castling squares are
+  // constants.
+  if (move_color(move) == WHITE)
+    board_doundo_move_color(board, move, nnue_activate, WHITE);
+  else
+    board_doundo_move_color(board, move, nnue_activate, BLACK);
+}
+
+ALWAYS_INLINE void board_doundo_move_color(Bitboard* board,
+                                           Move move,
+                                           int nnue_activate,
+                                           Color color) {
   // extract basic data
   uint8_t src = move_source_index(move);
   uint8_t dest = move_destination_index(move);
   Piecetype piece = move_piecetype(move);
-  Color color = move_color(move);
 
   if (piece == KING)
     nnue_activate = 0;
@@ -368,7 +508,7 @@ static void board_doundo_move_common(Bitboard* board,
   }
 
   board->to_move = (1 - board->to_move);
-  board->state->zobrist ^= board->zobrist_black;
+  board->state->zobrist ^= zobrist_black;
 
 #if ENABLE_NNUE
   if (piece == KING)
@@ -376,17 +516,30 @@ static void board_doundo_move_common(Bitboard* board,
 #endif
 }
 
-static void board_toggle_piece(Bitboard* board,
-                               Piecetype piece,
-                               Color color,
-                               uint8_t loc,
-                               int nnue_activate) {
+ALWAYS_INLINE void board_toggle_piece(Bitboard* board,
+                                      Piecetype piece,
+                                      Color color,
+                                      uint8_t loc,
+                                      int nnue_activate) {
   // flip the bit in all of the copies of the board state
   // TODO: try recomputing composities instead of xor all the time
   board->boards[color][piece] ^= 1ULL << loc;
   board->composite_boards[color] ^= 1ULL << loc;
   board->full_composite ^= 1ULL << loc;
-  board->state->zobrist ^= board->zobrist_pos[color][piece][loc];
+  board->state->zobrist ^= zobrist_pos[color][piece][loc];
+  if (piece == PAWN)
+    board->state->pawn_zobrist ^= zobrist_pos[color][PAWN][loc];
+  if (board->boards[color][piece] & (1ULL << loc)) {
+    board->state->material_key += MATERIAL_KEY(color, piece);
+    board->squares[loc] = piece;
+  } else {
+    board->state->material_key -= MATERIAL_KEY(color, piece);
+    // A capture puts the capturing piece on the square before taking off the
+    // captured one, so only clear the square if nothing else is there.
+    if (!(board->composite_boards[1 - color] & (1ULL << loc)))
+      board->squares[loc] = NO_PIECE;
+  }
+  evaluate_toggle_piece(board, piece, color, loc);
 
 #if ENABLE_NNUE
   nnue_toggle_piece(board, piece, color, loc, nnue_activate);
@@ -395,22 +548,53 @@ static void board_toggle_piece(Bitboard* board,
 #endif
 }
 
+static uint8_t board_castle_rights_after(uint8_t castle_rights, Move move) {
+  /* moving to or from a rook square means you can no longer castle on
+     that side */
+  uint8_t src = move_source_index(move);
+  uint8_t dest = move_destination_index(move);
+
+  if (src == 0 || dest == 0)
+    castle_rights &= ~(CASTLE_R(CASTLE_R_QS, WHITE));
+  if (src == 7 || dest == 7)
+    castle_rights &= ~(CASTLE_R(CASTLE_R_KS, WHITE));
+  if (src == 56 || dest == 56)
+    castle_rights &= ~(CASTLE_R(CASTLE_R_QS, BLACK));
+  if (src == 63 || dest == 63)
+    castle_rights &= ~(CASTLE_R(CASTLE_R_KS, BLACK));
+
+  /* moving your king at all means you can no longer castle on either
+     side. Castling also means you can no longer castle (again) on
+     either side */
+  if (move_is_castle(move) || move_piecetype(move) == KING)
+    castle_rights &= ~(CASTLE_R(CASTLE_R_BOTH, move_color(move)));
+
+  return castle_rights;
+}
+
 static uint64_t board_gen_king_attackers(const Bitboard* board, Color color) {
   return move_generate_attackers(board, 1 - color,
                                  bitscan(board->boards[color][KING]),
                                  board->full_composite);
 }
 
-static void board_update_expensive_state(Bitboard* board) {
+uint64_t board_compute_king_attackers(const Bitboard* board) {
   board->state->king_attackers =
       board_gen_king_attackers(board, board->to_move);
+  board->state->computed |= STATE_COMPUTED_KING_ATTACKERS;
+  return board->state->king_attackers;
+}
+
+uint64_t board_compute_pinned(const Bitboard* board) {
   board->state->pinned = move_generate_pinned(board, board->to_move);
+  board->state->computed |= STATE_COMPUTED_PINNED;
+  return board->state->pinned;
 }
 
 int board_in_check(const Bitboard* board, Color color) {
   uint64_t king_attackers;
   if (color == board->to_move)
-    king_attackers = board->state->king_attackers;
+    king_attackers = board_king_attackers(board);
   else
     // Board is not in a legal position if the person not to-move is in check.
     // We only do this as the final move legality check, so don't bother caching
@@ -1,6 +1,7 @@
 #ifndef _BITBOARD_H
 #define _BITBOARD_H
 
+#include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,19 +14,62 @@ void board_init(Bitboard* board, State* state);
 // writes board state from the fen to the board. Assumes a valid fen
 void board_init_with_fen(Bitboard* board, State* state, const char* fen);
 
+// writes a position with the given pieces to the board, with no castling
+// rights, enpassant, or halfmove count. Assumes a legal position
+void board_init_with_boards(Bitboard* board,
+                            State* state,
+                            uint64_t boards[2][6],
+                            Color to_move);
+
 // make and reverse moves on a board
 void board_do_move(Bitboard* board, Move move, State* state);
 void board_undo_move(Bitboard* board);
 
+// Identifies the set of zobrist keys, for anything which persists zobrists.
+uint64_t board_zobrist_fingerprint(void);
+
+// The zobrist the board would have after making move, without making it.
+uint64_t board_zobrist_after_move(const Bitboard* board, Move move);
+
+// If positions with zobrists differing by zobrist_diff are one move of a piece
+// other than a pawn apart, and nothing on board is in the way of that move,
+// the two squares it moves between. 0 otherwise.
+uint64_t board_reversible_move_squares(const Bitboard* board,
+                                       uint64_t zobrist_diff);
+
 // returns 1 if color's king is in check, 0 otherwise
 int board_in_check(const Bitboard* board, Color color);
 
+// Fill in the State fields behind board_king_attackers and board_pinned.
+uint64_t board_compute_king_attackers(const Bitboard* board);
+uint64_t board_compute_pinned(const Bitboard* board);
+
+// The enemy pieces attacking the king of the side to move.
+static inline uint64_t board_king_attackers(const Bitboard* board) {
+  if (board->state->computed & STATE_COMPUTED_KING_ATTACKERS)
+    return board->state->king_attackers;
+  return board_compute_king_attackers(board);
+}
+
+// The pieces of the side to move which are pinned to their king.
+static inline uint64_t board_pinned(const Bitboard* board) {
+  if (board->state->computed & STATE_COMPUTED_PINNED)
+    return board->state->pinned;
+  return board_compute_pinned(board);
+}
+
 // Write board's FEN to f.
 void board_fen(const Bitboard* board, FILE* f);
 
 // dump a primitive printout of the board to stdout
 void board_print(const Bitboard* board);
 
+// The material key of a board keeps the number of each piece of each color in
+// its own nibble, so, e.g., adding a white rook adds MATERIAL_KEY(WHITE, ROOK).
+#define MATERIAL_KEY(color, piece) (1ULL << (4 * (6 * (color) + (piece))))
+#define MATERIAL_COUNT(key, color, piece) \
+  ((int)(((key) / MATERIAL_KEY(color, piece)) & 0xF))
+
 // for all of these conversions, 0 <= row,col < 8
 #define board_index_of(row, col) ((col) | (uint8_t)((row) << 3))
 #define board_row_of(index) ((index) >> 3)
@@ -34,20 +78,8 @@ void board_print(const Bitboard* board);
 // undefined return value if there is no piece at index
 static inline Piecetype board_piecetype_at_index(const Bitboard* board,
                                                  uint8_t index) {
-  uint64_t bit_at_index = 1ULL << index;
-  Color color;
-
-  if (board->composite_boards[WHITE] & bit_at_index)
-    color = WHITE;
-  else
-    color = BLACK;
-
-  for (Piecetype result = 0; result <= 5; result++) {
-    if (board->boards[color][result] & bit_at_index)
-      return result;
-  }
-
-  abort();
+  assert(board->squares[index] != NO_PIECE);
+  return board->squares[index];
 }
 
 #endif
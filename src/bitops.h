@@ -3,6 +3,10 @@
 
 #include <stdint.h>
 
+// For functions which take a constant argument, like a Color, to make sure
+// each call gets its own copy with that constant folded in.
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
+
 static inline uint8_t bitscan(uint64_t x) {
   return (uint8_t)__builtin_ctzll(x);
 }
@@ -6,5 +6,7 @@
 #define ENABLE_HUGEPAGES_MMAP 0
 #define ENABLE_NNUE 1
 #define ENABLE_NNUE_SIMD 1
+#define ENABLE_PEXT 1
+#define ENABLE_SYZYGY 0
 
 #endif
@@ -37,7 +37,7 @@ int main(void) {
     printf("Traditional eval: %i\nNNUE eval: %i\n", evaluate_traditional(&test),
            nnue_evaluate(&test));
 #else
-    printf("Evaluation: %i\n", evaluate_board(test));
+    printf("Evaluation: %i\n", evaluate_board(&test));
 #endif
 
     Movelist moves;
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "../gen/evaluate.h"
@@ -10,6 +11,17 @@
 #include "movemagic.h"
 #include "nnue.h"
 
+typedef enum {
+  EVALUATOR_TRADITIONAL,
+  EVALUATOR_NNUE,
+} Evaluator;
+
+#if ENABLE_NNUE
+static Evaluator evaluator = EVALUATOR_NNUE;
+#else
+static Evaluator evaluator = EVALUATOR_TRADITIONAL;
+#endif
+
 // Horizontal reflection (B2 <-> B7 etc).
 #define FLIP(x) (56 ^ x)
 
@@ -112,78 +124,332 @@ static const int endgame_values[] = {175, 300, 300, 500, 1000, 0};
 
 #define doubled_pawn_penalty -10
 #define pawn_shield_bonus 7
+#define bishop_pair_bonus 30
 
-int evaluate_traditional(const Bitboard* board) {
+// Must be a power of two.
+#define PAWN_TABLE_SIZE (1 << 14)
+
+// The pawn structure changes rarely from one node to the next, so cache
+// everything which only depends on it, keyed by the pawn zobrist.
+typedef struct {
+  uint64_t pawn_zobrist;
+
+  // Doubled and passed pawns.
+  int16_t score[2];
+
+  // The shield bonus for a king on king_loc. Usually the king hasn't moved
+  // since the entry was last used either.
+  int16_t shield[2];
+  uint8_t king_loc[2];
+} PawnEntry;
+
+// An empty entry is correct for a board with no pawns, which has a zero pawn
+// zobrist, and kings on a1 and a1.
+static PawnEntry pawn_table[PAWN_TABLE_SIZE];
+
+static int evaluate_pawn_structure(const Bitboard* board, Color color) {
+  uint64_t pawns = board->boards[color][PAWN];
   int result = 0;
-  int endgame = popcnt(board->full_composite ^ board->boards[WHITE][PAWN] ^
-                       board->boards[BLACK][PAWN]) < 8;
-  Color to_move = board->to_move;
 
-  for (Color color = 0; color < 2; color++) {
-    int color_result = 0;
+  // doubled pawns
+  // 0x0101010101010101 masks a single column
+  for (int col = 0; col < 8; col++)
+    result += doubled_pawn_penalty *
+              (popcnt(pawns & (0x0101010101010101ULL << col)) - 1);
+
+  while (pawns) {
+    uint8_t loc = bitscan(pawns);
+    uint8_t flipped_loc = color == WHITE ? FLIP(loc) : loc;
+    pawns &= pawns - 1;
+
+    if ((front_spans[color][loc] & board->boards[1 - color][PAWN]) == 0)
+      result += passed_pawn_bonus[flipped_loc];
+  }
+
+  return result;
+}
+
+static int evaluate_pawn_shield(const Bitboard* board,
+                                Color color,
+                                uint8_t king_loc) {
+  uint8_t row = board_row_of(king_loc);
+  if ((color == WHITE && row != 0) || (color == BLACK && row != 7))
+    return 0;
+
+  // Take the two rows in front of the king (suitably shifted up for black).
+  // Intersect that with front spans to find useful spots for pawn shields.
+  uint64_t shield_rows = 0x0000000000ffff00ULL << (32 * color);
+  uint64_t shield = front_spans[color][king_loc] & shield_rows;
+  return pawn_shield_bonus * popcnt(shield & board->boards[color][PAWN]);
+}
+
+static const PawnEntry* evaluate_pawn_entry(const Bitboard* board) {
+  uint64_t pawn_zobrist = board->state->pawn_zobrist;
+  PawnEntry* entry = &pawn_table[pawn_zobrist & (PAWN_TABLE_SIZE - 1)];
+
+  if (entry->pawn_zobrist != pawn_zobrist) {
+    entry->pawn_zobrist = pawn_zobrist;
+    for (Color color = WHITE; color <= BLACK; color++) {
+      entry->score[color] = (int16_t)evaluate_pawn_structure(board, color);
+      entry->king_loc[color] = bitscan(board->boards[color][KING]);
+      entry->shield[color] = (int16_t)evaluate_pawn_shield(
+          board, color, entry->king_loc[color]);
+    }
+    return entry;
+  }
+
+  for (Color color = WHITE; color <= BLACK; color++) {
+    uint8_t king_loc = bitscan(board->boards[color][KING]);
+    if (entry->king_loc[color] != king_loc) {
+      entry->king_loc[color] = king_loc;
+      entry->shield[color] =
+          (int16_t)evaluate_pawn_shield(board, color, king_loc);
+    }
+  }
+
+  return entry;
+}
+
+#define MATERIAL_TABLE_BITS 13
+#define MATERIAL_TABLE_SIZE (1 << MATERIAL_TABLE_BITS)
+
+// Scale factors are out of SCALE_NORMAL.
+#define SCALE_NORMAL 64
+#define SCALE_DRAWISH 16
+
+// Neither side can force mate.
+#define MATERIAL_DRAW (1 << 0)
+// One bishop each and otherwise only pawns, so opposite colored bishops are
+// possible.
+#define MATERIAL_BISHOPS (1 << 1)
+
+#define LIGHT_SQUARES 0x55aa55aa55aa55aaULL
+
+// Everything which only depends on how much of each piece there is, keyed by
+// the material key.
+typedef struct {
+  uint64_t material_key;
+
+  // From white's point of view.
+  int16_t imbalance;
+
+  // Applied to the evaluation when color is ahead.
+  uint8_t scale[2];
+  uint8_t flags;
+} MaterialEntry;
 
-    // XXX bring back has-castled bonus? (10)
+// Kings are always on the board, so a real material key is never zero.
+static MaterialEntry material_table[MATERIAL_TABLE_SIZE];
 
-    // doubled pawns
-    // 0x0101010101010101 masks a single column
-    for (int col = 0; col < 8; col++)
-      color_result +=
-          doubled_pawn_penalty *
-          (popcnt(board->boards[color][PAWN] & (0x0101010101010101ULL << col)) -
-           1);
+static void evaluate_material_compute(uint64_t key, MaterialEntry* entry) {
+  int pawns[2], non_pawn[2];
+
+  for (Color color = WHITE; color <= BLACK; color++) {
+    pawns[color] = MATERIAL_COUNT(key, color, PAWN);
+    non_pawn[color] = 0;
+    for (Piecetype piece = BISHOP; piece <= QUEEN; piece++)
+      non_pawn[color] += values[piece] * MATERIAL_COUNT(key, color, piece);
+  }
+
+  entry->material_key = key;
+  entry->imbalance = 0;
+  entry->flags = 0;
+
+  for (Color color = WHITE; color <= BLACK; color++) {
+    Color other = 1 - color;
+    int sign = color == WHITE ? 1 : -1;
+
+    if (MATERIAL_COUNT(key, color, BISHOP) >= 2)
+      entry->imbalance += sign * bishop_pair_bonus;
+
+    // Without pawns, a single minor piece can't mate, and nor can two knights
+    // against a bare king.
+    int cant_win = pawns[color] == 0 &&
+                   (non_pawn[color] <= values[BISHOP] ||
+                    (MATERIAL_COUNT(key, color, KNIGHT) == 2 &&
+                     non_pawn[color] == 2 * values[KNIGHT] &&
+                     non_pawn[other] == 0 && pawns[other] == 0));
+
+    if (cant_win)
+      entry->scale[color] = 0;
+    else if (pawns[color] == 0 &&
+             non_pawn[color] - non_pawn[other] <= values[BISHOP])
+      entry->scale[color] = SCALE_DRAWISH;
+    else
+      entry->scale[color] = SCALE_NORMAL;
+  }
+
+  if (entry->scale[WHITE] == 0 && entry->scale[BLACK] == 0)
+    entry->flags |= MATERIAL_DRAW;
+
+  if (MATERIAL_COUNT(key, WHITE, BISHOP) == 1 &&
+      MATERIAL_COUNT(key, BLACK, BISHOP) == 1 &&
+      non_pawn[WHITE] == values[BISHOP] && non_pawn[BLACK] == values[BISHOP])
+    entry->flags |= MATERIAL_BISHOPS;
+}
 
-    for (Piecetype piece = 0; piece < 6; piece++) {
+static const MaterialEntry* evaluate_material_entry(const Bitboard* board) {
+  uint64_t key = board->state->material_key;
+  // The key's low bits are mostly pawn counts, so mix it up a bit.
+  MaterialEntry* entry = &material_table[(key * 0x9e3779b97f4a7c15ULL) >>
+                                         (64 - MATERIAL_TABLE_BITS)];
+
+  if (entry->material_key != key)
+    evaluate_material_compute(key, entry);
+
+  return entry;
+}
+
+int evaluate_is_known_draw(const Bitboard* board) {
+  return (evaluate_material_entry(board)->flags & MATERIAL_DRAW) != 0;
+}
+
+// Middlegame and endgame material plus square table value of the piece, from
+// white's point of view.
+static void evaluate_piece(Piecetype piece,
+                           Color color,
+                           uint8_t loc,
+                           int material[2]) {
+  uint8_t flipped_loc = color == WHITE ? FLIP(loc) : loc;
+  int sign = color == WHITE ? 1 : -1;
+
+  material[0] = values[piece];
+  material[1] = endgame_values[piece];
+  if (pos_tables[piece])
+    material[0] += pos_tables[piece][flipped_loc];
+  if (endgame_pos_tables[piece])
+    material[1] += endgame_pos_tables[piece][flipped_loc];
+
+  material[0] *= sign;
+  material[1] *= sign;
+}
+
+void evaluate_reset(Bitboard* board) {
+  board->material[0] = board->material[1] = 0;
+  board->phase = 0;
+
+  for (Color color = WHITE; color <= BLACK; color++) {
+    for (Piecetype piece = PAWN; piece <= KING; piece++) {
       uint64_t pieces = board->boards[color][piece];
       while (pieces) {
         uint8_t loc = bitscan(pieces);
-        uint8_t flipped_loc = color == WHITE ? FLIP(loc) : loc;
         pieces &= pieces - 1;
 
-        if (piece == PAWN) {
-          if ((front_spans[color][loc] & board->boards[1 - color][PAWN]) == 0)
-            color_result += passed_pawn_bonus[flipped_loc];
-        } else if (piece == KING) {
-          uint8_t row = board_row_of(loc);
-          if ((color == WHITE && row == 0) || (color == BLACK && row == 7)) {
-            // Take the two rows in front of the king (suitably shifted up for
-            // black). Intersect that with front spans to find useful spots for
-            // pawn shields.
-            uint64_t shield_rows = 0x0000000000ffff00ULL << (32 * color);
-            uint64_t shield = front_spans[color][loc] & shield_rows;
-            color_result +=
-                pawn_shield_bonus * popcnt(shield & board->boards[color][PAWN]);
-          }
-        }
-
-        const int* table =
-            endgame ? endgame_pos_tables[piece] : pos_tables[piece];
-        if (table)
-          color_result += table[flipped_loc];
-        color_result += (endgame ? endgame_values[piece] : values[piece]);
-
-        // add in a bonus for every square that this piece can attack
-        // only do this for bishops and rooks; knights are sufficiently taken
-        // care of by positional bonus, and this will emphasize queens too much
-        if (piece == BISHOP)
-          color_result += popcnt(movemagic_bishop(loc, board->full_composite));
-        if (piece == ROOK)
-          color_result += popcnt(movemagic_rook(loc, board->full_composite));
+        int material[2];
+        evaluate_piece(piece, color, loc, material);
+        board->material[0] += material[0];
+        board->material[1] += material[1];
+        if (piece != PAWN)
+          board->phase++;
       }
     }
+  }
+}
 
-    if (color == to_move)
-      result += color_result;
-    else
-      result -= color_result;
+void evaluate_toggle_piece(Bitboard* board,
+                           Piecetype piece,
+                           Color color,
+                           uint8_t loc) {
+  int material[2];
+  evaluate_piece(piece, color, loc, material);
+
+  // The piece has already been toggled on the board.
+  if (board->boards[color][piece] & (1ULL << loc)) {
+    board->material[0] += material[0];
+    board->material[1] += material[1];
+    if (piece != PAWN)
+      board->phase++;
+  } else {
+    board->material[0] -= material[0];
+    board->material[1] -= material[1];
+    if (piece != PAWN)
+      board->phase--;
   }
+}
 
-  return result;
+// The endgame tables were tuned for switching over all at once when fewer than
+// 8 pieces (kings included) are left, so that's the blend we use.
+static int evaluate_material(const Bitboard* board) {
+  return board->material[board->phase < 8];
 }
 
-int evaluate_board(const Bitboard* board) {
+int evaluate_traditional(const Bitboard* board) {
+  const MaterialEntry* material_entry = evaluate_material_entry(board);
+  if (material_entry->flags & MATERIAL_DRAW)
+    return DRAW;
+
+  int result = evaluate_material(board) + material_entry->imbalance;
+  const PawnEntry* pawn_entry = evaluate_pawn_entry(board);
+
+  result += pawn_entry->score[WHITE] + pawn_entry->shield[WHITE];
+  result -= pawn_entry->score[BLACK] + pawn_entry->shield[BLACK];
+
+  // XXX bring back has-castled bonus? (10)
+
+  // add in a bonus for every square that this piece can attack
+  // only do this for bishops and rooks; knights are sufficiently taken
+  // care of by positional bonus, and this will emphasize queens too much
+  for (Color color = WHITE; color <= BLACK; color++) {
+    int mobility = 0;
+
+    uint64_t bishops = board->boards[color][BISHOP];
+    while (bishops) {
+      uint8_t loc = bitscan(bishops);
+      bishops &= bishops - 1;
+      mobility += popcnt(movemagic_bishop(loc, board->full_composite));
+    }
+
+    uint64_t rooks = board->boards[color][ROOK];
+    while (rooks) {
+      uint8_t loc = bitscan(rooks);
+      rooks &= rooks - 1;
+      mobility += popcnt(movemagic_rook(loc, board->full_composite));
+    }
+
+    result += color == WHITE ? mobility : -mobility;
+  }
+
+  int scale = material_entry->scale[result > 0 ? WHITE : BLACK];
+  if (material_entry->flags & MATERIAL_BISHOPS) {
+    uint64_t bishops =
+        board->boards[WHITE][BISHOP] | board->boards[BLACK][BISHOP];
+    if (popcnt(bishops & LIGHT_SQUARES) == 1)
+      scale /= 2;
+  }
+  result = result * scale / SCALE_NORMAL;
+
+  return board->to_move == WHITE ? result : -result;
+}
+
+int evaluate_set_evaluator(const char* name) {
+  if (!strcmp(name, "traditional")) {
+    evaluator = EVALUATOR_TRADITIONAL;
+    return 0;
+  }
+
 #if ENABLE_NNUE
-  return nnue_evaluate(board);
+  // Reload the built-in network, in case a file was loaded over it.
+  if (!strcmp(name, "nnue")) {
+    nnue_init();
+    evaluator = EVALUATOR_NNUE;
+    return 0;
+  }
+
+  if (nnue_load(name) == 0) {
+    evaluator = EVALUATOR_NNUE;
+    return 0;
+  }
 #else
-  return evaluate_traditional(board);
+  fprintf(stderr, "Built without NNUE: %s\n", name);
 #endif
+
+  return -1;
+}
+
+int evaluate_board(const Bitboard* board) {
+#if ENABLE_NNUE
+  if (evaluator == EVALUATOR_NNUE)
+    return nnue_evaluate(board);
+#endif
+  return evaluate_traditional(board);
 }
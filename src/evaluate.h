@@ -4,6 +4,24 @@
 #include "types.h"
 
 int evaluate_board(const Bitboard* board);
+
+// Choose what evaluate_board uses: "traditional", "nnue" for the built-in
+// network, or the filename of a network to load. Defaults to the built-in
+// network if built with ENABLE_NNUE, and traditional otherwise. Boards which
+// are already set up need an nnue_reset after loading a network. Returns 0 on
+// success.
+int evaluate_set_evaluator(const char* name);
 int evaluate_traditional(const Bitboard* board);
 
+// Is the material on the board such that neither side can force mate?
+int evaluate_is_known_draw(const Bitboard* board);
+
+// Keep the board's running material and square table sums up to date. Called
+// by the board code, after it has toggled the piece on or off.
+void evaluate_reset(Bitboard* board);
+void evaluate_toggle_piece(Bitboard* board,
+                           Piecetype piece,
+                           Color color,
+                           uint8_t loc);
+
 #endif
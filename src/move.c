@@ -10,22 +10,56 @@
 
 #define INSERT_MOVE(movelist, move) (movelist->moves[movelist->n++] = (move))
 
+// Where the generator writes moves, whether that's a Movelist or not.
+typedef struct {
+  Move* moves;
+  uint8_t n;
+} MoveSink;
+
+#define COL_A 0x0101010101010101ULL
+#define COL_H 0x8080808080808080ULL
+#define ROW_3 0x0000000000FF0000ULL
+#define ROW_6 0x0000FF0000000000ULL
+#define PROMOTION_ROWS 0xFF000000000000FFULL
+
 static uint64_t move_generate_attacks_composite(uint64_t full_composite,
                                                 Piecetype piece,
                                                 Color color,
                                                 uint8_t index);
 
-static void move_generate_movelist_pawn_push(const Bitboard* board,
-                                             Movelist* movelist,
-                                             uint64_t non_capture_mask,
-                                             MoveGenMode m);
-static void move_generate_movelist_castle(const Bitboard* board,
-                                          Movelist* movelist);
+ALWAYS_INLINE void move_generate_movelist_color(const Bitboard* board,
+                                               MoveSink* movelist,
+                                               MoveGenMode m,
+                                               Color to_move);
+ALWAYS_INLINE void move_generate_movelist_pawns(const Bitboard* board,
+                                                MoveSink* movelist,
+                                                uint64_t pawns,
+                                                uint64_t capture_mask,
+                                                uint64_t non_capture_mask,
+                                                MoveGenMode m,
+                                                Color to_move);
+ALWAYS_INLINE void move_insert_pawn_moves(const Bitboard* board,
+                                          MoveSink* movelist,
+                                          uint64_t dests,
+                                          int delta,
+                                          int all_promotions,
+                                          Color to_move);
+ALWAYS_INLINE void move_generate_movelist_castle(const Bitboard* board,
+                                                 MoveSink* movelist,
+                                                 Color color);
 static void move_generate_movelist_enpassant(const Bitboard* board,
-                                             Movelist* movelist,
+                                             MoveSink* movelist,
                                              int in_single_check,
-                                             uint64_t non_capture_mask);
-static Move move_generate_enpassant_move(const Bitboard* board, uint8_t src);
+                                             uint64_t non_capture_mask,
+                                             Color color);
+static Move move_generate_enpassant_move(const Bitboard* board,
+                                         uint8_t src,
+                                         Color color);
+static uint64_t move_generate_blockers(const Bitboard* board,
+                                       Color color,
+                                       Color blocker_color);
+static void move_compute_check_info(const Bitboard* board);
+static int move_gives_check_slow(const Bitboard* board, Move m);
 
 #define make_move(src, dest, piece, to_move)           \
   ((unsigned)(src) << move_source_index_offset |       \
@@ -48,25 +82,47 @@ static Move move_generate_enpassant_move(const Bitboard* board, uint8_t src);
                                              << move_type_offset)
 
 void move_init(void) {
-  movemagic_init();
+  // Nothing to do at the moment: the slider attack tables are all generated at
+  // build time.
 }
 
 void move_generate_movelist(const Bitboard* board,
                             Movelist* movelist,
                             MoveGenMode m) {
-  movelist->n = 0;
+  movelist->n = move_generate_moves(board, movelist->moves, m);
+}
 
-  Color to_move = board->to_move;
+uint8_t move_generate_moves(const Bitboard* board,
+                            Move* moves,
+                            MoveGenMode m) {
+  MoveSink sink = {moves, 0};
 
-  int in_double_check = twobits(board->state->king_attackers);
-  int in_single_check = !in_double_check && board->state->king_attackers > 0;
-  uint8_t king_loc = bitscan(board->boards[board->to_move][KING]);
+  // Generate a copy of everything for each color, so that all of the
+  // color-dependent shifts, masks and board indexes are constants.
+  if (board->to_move == WHITE)
+    move_generate_movelist_color(board, &sink, m, WHITE);
+  else
+    move_generate_movelist_color(board, &sink, m, BLACK);
+
+  return sink.n;
+}
+
+ALWAYS_INLINE void move_generate_movelist_color(const Bitboard* board,
+                                               MoveSink* movelist,
+                                               MoveGenMode m,
+                                               Color to_move) {
+  uint64_t king_attackers = board_king_attackers(board);
+  uint64_t pinned = board_pinned(board);
+
+  int in_double_check = twobits(king_attackers);
+  int in_single_check = !in_double_check && king_attackers > 0;
+  uint8_t king_loc = bitscan(board->boards[to_move][KING]);
 
   uint64_t non_capture_mask = ~0ULL;
   if (in_single_check) {
     // To block a check, need to move to one of the squares the attacking piece
     // is attacking.
-    uint8_t index = bitscan(board->state->king_attackers);
+    uint8_t index = bitscan(king_attackers);
     Piecetype checker = board_piecetype_at_index(board, index);
     switch (checker) {
       case QUEEN:
@@ -84,12 +140,33 @@ void move_generate_movelist(const Bitboard* board,
         break;
     }
 
-    uint64_t between = raycast[king_loc][index] & raycast[index][king_loc];
-    non_capture_mask &= between;
+    non_capture_mask &= between[king_loc][index];
+  }
+
+  // In double check, the king must move, so skip generating other moves.
+  if (!in_double_check) {
+    // Other pieces can only get us out of check by capturing the checking
+    // piece.
+    uint64_t capture_mask = in_single_check ? king_attackers : ~0ULL;
+    uint64_t pawns = board->boards[to_move][PAWN];
+
+    move_generate_movelist_pawns(board, movelist, pawns & ~pinned,
+                                 capture_mask, non_capture_mask, m, to_move);
+
+    // Pinned pawns can only move along the pin, so do each on its own.
+    uint64_t pinned_pawns = pawns & pinned;
+    while (pinned_pawns) {
+      uint8_t src = bitscan(pinned_pawns);
+      pinned_pawns &= pinned_pawns - 1;
+
+      uint64_t pin = line[king_loc][src];
+      move_generate_movelist_pawns(board, movelist, 1ULL << src,
+                                   capture_mask & pin, non_capture_mask & pin,
+                                   m, to_move);
+    }
   }
 
-  for (Piecetype piece = 0; piece < 6; piece++) {
-    // In double check, the king must move, so skip generating other moves.
+  for (Piecetype piece = BISHOP; piece <= KING; piece++) {
     if (in_double_check && piece != KING)
       continue;
 
@@ -104,17 +181,17 @@ void move_generate_movelist(const Bitboard* board,
           ~(board->composite_boards[to_move]);  // can't capture your own piece
       // Do not bother to mask off dests for the king which are in check:
       // move_is_legal tests that.
-      if (board->state->pinned & (1ULL << src))
-        dests &= raycast[king_loc][src];  // Pinned movement restricted.
+      if (pinned & (1ULL << src))
+        dests &= line[king_loc][src];  // Pinned movement restricted.
 
       uint64_t captures = dests & board->composite_boards[1 - to_move];
       if (in_single_check && piece != KING)
         // Other pieces can only get us out of check by capturing the checking
         // piece.
-        captures &= board->state->king_attackers;
+        captures &= king_attackers;
 
       uint64_t non_captures;
-      if (m == MOVE_GEN_QUIET || piece == PAWN) {
+      if (m == MOVE_GEN_QUIET) {
         non_captures = 0;
       } else {
         non_captures = dests & ~(board->composite_boards[1 - to_move]);
@@ -126,18 +203,9 @@ void move_generate_movelist(const Bitboard* board,
         uint8_t dest = bitscan(captures);
         captures &= captures - 1;
 
-        Move move = make_move_capture(make_move(src, dest, piece, to_move),
-                                      board_piecetype_at_index(board, dest));
-
-        if (piece == PAWN &&
-            (board_row_of(dest) == 0 || board_row_of(dest) == 7)) {
-          INSERT_MOVE(movelist, make_move_promotion(move, QUEEN));
-          INSERT_MOVE(movelist, make_move_promotion(move, ROOK));
-          INSERT_MOVE(movelist, make_move_promotion(move, BISHOP));
-          INSERT_MOVE(movelist, make_move_promotion(move, KNIGHT));
-        } else {
-          INSERT_MOVE(movelist, move);
-        }
+        INSERT_MOVE(movelist,
+                    make_move_capture(make_move(src, dest, piece, to_move),
+                                      board_piecetype_at_index(board, dest)));
       }
 
       while (non_captures) {
@@ -148,14 +216,11 @@ void move_generate_movelist(const Bitboard* board,
     }
   }
 
-  if (!in_double_check) {
-    move_generate_movelist_pawn_push(board, movelist, non_capture_mask, m);
-    if (m != MOVE_GEN_QUIET) {
-      if (!in_single_check)
-        move_generate_movelist_castle(board, movelist);
-      move_generate_movelist_enpassant(board, movelist, in_single_check,
-                                       non_capture_mask);
-    }
+  if (!in_double_check && m != MOVE_GEN_QUIET) {
+    if (!in_single_check)
+      move_generate_movelist_castle(board, movelist, to_move);
+    move_generate_movelist_enpassant(board, movelist, in_single_check,
+                                     non_capture_mask, to_move);
   }
 }
 
@@ -224,7 +289,51 @@ int move_is_legal(const Bitboard* board, Move m) {
   }
 }
 
+static void move_compute_check_info(const Bitboard* board) {
+  Color to_move = board->to_move;
+  uint8_t king_loc = bitscan(board->boards[!to_move][KING]);
+  uint64_t bishop_attacks = movemagic_bishop(king_loc, board->full_composite);
+  uint64_t rook_attacks = movemagic_rook(king_loc, board->full_composite);
+
+  State* state = board->state;
+  state->check_squares[PAWN] = pawn_attacks[!to_move][king_loc];
+  state->check_squares[BISHOP] = bishop_attacks;
+  state->check_squares[KNIGHT] = knight_attacks[king_loc];
+  state->check_squares[ROOK] = rook_attacks;
+  state->check_squares[QUEEN] = bishop_attacks | rook_attacks;
+  state->check_squares[KING] = 0;
+  state->discoverers = move_generate_blockers(board, !to_move, to_move);
+  state->computed |= STATE_COMPUTED_CHECK_INFO;
+}
+
 int move_gives_check(const Bitboard* board, Move m) {
+  // These all move or remove a second piece, which the check info doesn't
+  // account for. They're rare enough to just work out the long way.
+  if (move_is_castle(m) || move_is_enpassant(m) || move_is_promotion(m))
+    return move_gives_check_slow(board, m);
+
+  if (!(board->state->computed & STATE_COMPUTED_CHECK_INFO))
+    move_compute_check_info(board);
+
+  uint8_t src = move_source_index(m);
+  uint8_t dest = move_destination_index(m);
+
+  // The moving piece can't be blocking its own line to the king from dest,
+  // since then it would already be attacking the king from src.
+  if (board->state->check_squares[move_piecetype(m)] & (1ULL << dest))
+    return 1;
+
+  // A discovered check, unless the piece stays on the line it was blocking.
+  if (board->state->discoverers & (1ULL << src)) {
+    uint8_t king_loc = bitscan(board->boards[!board->to_move][KING]);
+    if ((line[king_loc][src] & (1ULL << dest)) == 0)
+      return 1;
+  }
+
+  return 0;
+}
+
+static int move_gives_check_slow(const Bitboard* board, Move m) {
   Color to_move = board->to_move;
   uint8_t src = move_source_index(m);
   uint8_t dest = move_destination_index(m);
@@ -273,18 +382,29 @@ int move_gives_check(const Bitboard* board, Move m) {
 }
 
 uint64_t move_generate_pinned(const Bitboard* board, Color color) {
+  return move_generate_blockers(board, color, color);
+}
+
+// The pieces of blocker_color which are alone in between color's king and an
+// enemy slider.
+static uint64_t move_generate_blockers(const Bitboard* board,
+                                       Color color,
+                                       Color blocker_color) {
   // We compute pinned pieces using an algorithm inspired by Stockfish:
   // - compute "snipers": the enemy sliding pieces which could hit the king if
   //   there were no other pieces in the way (empty occupancy to movemagic)
   // - compute "targets": everything that could get in the way of the sniper to
   //   the king (i.e., anything except the snipers or the king)
   // - for each sniper, if there is exactly one target in the area between the
-  //   sniper and the king, and that piece is our piece, then it is pinned
+  //   sniper and the king, and that piece is blocker_color, then it is pinned
   //
   // When doing movegen, if a piece is pinned, moving it is only legal if its
-  // destination is the same ray from the king to its source location (since its
-  // pinning attacker must be further along that ray, that means it stays in
+  // destination is on the line through the king and its source location (since
+  // it can't jump over the king or its pinning attacker, that means it stays in
   // between the two).
+  //
+  // The pieces which could move to give a discovered check are found the same
+  // way, from the other side: blockers of our own sliders to the enemy king.
 
   uint8_t king_loc = bitscan(board->boards[color][KING]);
   uint64_t king_bishop = movemagic_bishop(king_loc, 0);
@@ -299,20 +419,18 @@ uint64_t move_generate_pinned(const Bitboard* board, Color color) {
   uint64_t targets =
       board->full_composite & ~snipers & ~board->boards[color][KING];
 
-  uint64_t pinned = 0;
+  uint64_t blockers = 0;
   while (snipers) {
     uint8_t sniper_loc = bitscan(snipers);
     snipers &= snipers - 1;
 
-    uint64_t between =
-        raycast[king_loc][sniper_loc] & raycast[sniper_loc][king_loc];
-
-    uint64_t hits = targets & between;
-    if (hits > 0 && !twobits(hits) && (hits & board->composite_boards[color]))
-      pinned |= hits;
+    uint64_t hits = targets & between[king_loc][sniper_loc];
+    if (hits > 0 && !twobits(hits) &&
+        (hits & board->composite_boards[blocker_color]))
+      blockers |= hits;
   }
 
-  return pinned;
+  return blockers;
 }
 
 uint64_t move_generate_attackers(const Bitboard* board,
@@ -331,76 +449,84 @@ uint64_t move_generate_attackers(const Bitboard* board,
          (pawn_attacks[1 - attacker][square] & board->boards[attacker][PAWN]);
 }
 
-static void move_generate_movelist_pawn_push(const Bitboard* board,
-                                             Movelist* movelist,
-                                             uint64_t non_capture_mask,
-                                             MoveGenMode m) {
-  Color to_move = board->to_move;
-  uint64_t pawns = board->boards[to_move][PAWN];
-
-  uint8_t king_loc = bitscan(board->boards[board->to_move][KING]);
-
-  while (pawns) {
-    uint8_t src = bitscan(pawns);
-    pawns &= pawns - 1;
-
-    int pinned = (board->state->pinned & (1ULL << src)) > 0;
-
-    uint8_t row = board_row_of(src);
-    uint8_t col = board_col_of(src);
-
-    // try to move one space forward
-    if ((to_move == WHITE && row < 7) || (to_move == BLACK && row > 0)) {
-      uint8_t dest;
-      if (to_move == WHITE)
-        dest = board_index_of(row + 1, col);
-      else
-        dest = board_index_of(row - 1, col);
-
-      if (pinned && (raycast[king_loc][src] & (1ULL << dest)) == 0)
-        continue;
-
-      uint64_t one_forward = 1ULL << dest;
-      uint64_t one_forward_blocked = board->full_composite & one_forward;
-      uint64_t one_forward_unmasked = non_capture_mask & one_forward;
-      if (!one_forward_blocked && one_forward_unmasked) {
-        Move move = make_move(src, dest, PAWN, to_move);
-
-        // promote if needed
-        if ((to_move == WHITE && row == 6) || (to_move == BLACK && row == 1)) {
-          INSERT_MOVE(movelist, make_move_promotion(move, QUEEN));
-          if (m != MOVE_GEN_QUIET) {
-            INSERT_MOVE(movelist, make_move_promotion(move, ROOK));
-            INSERT_MOVE(movelist, make_move_promotion(move, BISHOP));
-            INSERT_MOVE(movelist, make_move_promotion(move, KNIGHT));
-          }
-        } else if (m != MOVE_GEN_QUIET) {
-          INSERT_MOVE(movelist, move);
-        }
-      }
+ALWAYS_INLINE void move_generate_movelist_pawns(const Bitboard* board,
+                                                MoveSink* movelist,
+                                                uint64_t pawns,
+                                                uint64_t capture_mask,
+                                                uint64_t non_capture_mask,
+                                                MoveGenMode m,
+                                                Color to_move) {
+  // Each kind of pawn move is a shift of the whole set of pawns: forward is
+  // +8 for white and -8 for black, and the captures go one column either side
+  // (so mask off the pawns on the edge columns first).
+  uint64_t empty = ~board->full_composite;
+  uint64_t left, right, single, twice;
+  int forward;
+  if (to_move == WHITE) {
+    forward = 8;
+    left = (pawns & ~COL_A) << 7;
+    right = (pawns & ~COL_H) << 9;
+    single = (pawns << 8) & empty;
+    twice = ((single & ROW_3) << 8) & empty;
+  } else {
+    forward = -8;
+    left = (pawns & ~COL_A) >> 9;
+    right = (pawns & ~COL_H) >> 7;
+    single = (pawns >> 8) & empty;
+    twice = ((single & ROW_6) >> 8) & empty;
+  }
+
+  uint64_t targets = board->composite_boards[1 - to_move] & capture_mask;
+  move_insert_pawn_moves(board, movelist, left & targets, forward - 1, 1,
+                         to_move);
+  move_insert_pawn_moves(board, movelist, right & targets, forward + 1, 1,
+                         to_move);
+
+  single &= non_capture_mask;
+  twice &= non_capture_mask;
+  if (m == MOVE_GEN_QUIET) {
+    // Only queen promotions count as quiet.
+    move_insert_pawn_moves(board, movelist, single & PROMOTION_ROWS, forward,
+                           0, to_move);
+  } else {
+    move_insert_pawn_moves(board, movelist, single, forward, 1, to_move);
+    move_insert_pawn_moves(board, movelist, twice, 2 * forward, 1, to_move);
+  }
+}
 
-      if (!one_forward_blocked && m != MOVE_GEN_QUIET) {
-        // try to move two spaces forward
-        if ((to_move == WHITE && row == 1) || (to_move == BLACK && row == 6)) {
-          if (to_move == WHITE)
-            dest = board_index_of(row + 2, col);
-          else
-            dest = board_index_of(row - 2, col);
-
-          uint64_t two_forward = (1ULL << dest);
-          uint64_t two_forward_blocked = board->full_composite & two_forward;
-          uint64_t two_forward_unmasked = non_capture_mask & two_forward;
-          if (!two_forward_blocked && two_forward_unmasked) {
-            INSERT_MOVE(movelist, make_move(src, dest, PAWN, to_move));
-          }
-        }
+ALWAYS_INLINE void move_insert_pawn_moves(const Bitboard* board,
+                                          MoveSink* movelist,
+                                          uint64_t dests,
+                                          int delta,
+                                          int all_promotions,
+                                          Color to_move) {
+  uint64_t captures = dests & board->full_composite;
+
+  while (dests) {
+    uint8_t dest = bitscan(dests);
+    uint64_t bit = dests & -dests;
+    dests &= dests - 1;
+
+    Move move = make_move((uint8_t)(dest - delta), dest, PAWN, to_move);
+    if (captures & bit)
+      move = make_move_capture(move, board_piecetype_at_index(board, dest));
+
+    if (bit & PROMOTION_ROWS) {
+      INSERT_MOVE(movelist, make_move_promotion(move, QUEEN));
+      if (all_promotions) {
+        INSERT_MOVE(movelist, make_move_promotion(move, ROOK));
+        INSERT_MOVE(movelist, make_move_promotion(move, BISHOP));
+        INSERT_MOVE(movelist, make_move_promotion(move, KNIGHT));
       }
+    } else {
+      INSERT_MOVE(movelist, move);
     }
   }
 }
 
-static void move_generate_movelist_castle(const Bitboard* board,
-                                          Movelist* movelist) {
+ALWAYS_INLINE void move_generate_movelist_castle(const Bitboard* board,
+                                                 MoveSink* movelist,
+                                                 Color color) {
   // squares that must be clear for a castle: (along with the king not being in
   // check) W QS: empty 1 2 3, not attacked 2 3 W KS: empty 5 6, not attacked 5
   // 6 B QS: empty 57 58 59, not attacked 58 59 B KS: empty 61 62, not attacked
@@ -414,8 +540,6 @@ static void move_generate_movelist_castle(const Bitboard* board,
   // tests that. (And it assumes it will not be called in the first place if the
   // king is already in check.)
 
-  Color color = board->to_move;
-
   // white queenside
   if ((color == WHITE) &&
       (board->state->castle_rights & CASTLE_R(CASTLE_R_QS, WHITE))) {
@@ -454,40 +578,42 @@ static void move_generate_movelist_castle(const Bitboard* board,
 }
 
 static void move_generate_movelist_enpassant(const Bitboard* board,
-                                             Movelist* movelist,
+                                             MoveSink* movelist,
                                              int in_single_check,
-                                             uint64_t non_capture_mask) {
+                                             uint64_t non_capture_mask,
+                                             Color color) {
   uint8_t ep_index = board->state->enpassant_index;
   if (ep_index == 0)
     return;
 
   if (in_single_check) {
-    uint8_t dest = board->to_move == WHITE ? ep_index + 8 : ep_index - 8;
+    uint8_t dest = color == WHITE ? ep_index + 8 : ep_index - 8;
     uint64_t dest_mask = 1ULL << dest;
     uint64_t captured_mask = 1ULL << ep_index;
 
     // If we are in check, an enpassant move is invalid unless we either capture
     // the checking piece or land somewhere to block the check.
     if ((dest_mask & non_capture_mask) == 0 &&
-        (captured_mask & board->state->king_attackers) == 0)
+        (captured_mask & board_king_attackers(board)) == 0)
       return;
   }
 
   if (board_col_of(ep_index) > 0) {
-    Move move = move_generate_enpassant_move(board, ep_index - 1);
+    Move move = move_generate_enpassant_move(board, ep_index - 1, color);
     if (move != MOVE_NULL)
       INSERT_MOVE(movelist, move);
   }
 
   if (board_col_of(ep_index) < 7) {
-    Move move = move_generate_enpassant_move(board, ep_index + 1);
+    Move move = move_generate_enpassant_move(board, ep_index + 1, color);
     if (move != MOVE_NULL)
       INSERT_MOVE(movelist, move);
   }
 }
 
-static Move move_generate_enpassant_move(const Bitboard* board, uint8_t src) {
-  Color color = board->to_move;
+static Move move_generate_enpassant_move(const Bitboard* board,
+                                         uint8_t src,
+                                         Color color) {
   if ((board->boards[color][PAWN] & (1ULL << src)) == 0)
     return MOVE_NULL;
 
@@ -496,8 +622,8 @@ static Move move_generate_enpassant_move(const Bitboard* board, uint8_t src) {
   uint8_t king_loc = bitscan(board->boards[color][KING]);
 
   // Standard pin check: if we are pinned we need to land along the pinning ray.
-  if ((board->state->pinned & (1ULL << src)) != 0 &&
-      (raycast[king_loc][src] & (1ULL << dest)) == 0)
+  if ((board_pinned(board) & (1ULL << src)) != 0 &&
+      (line[king_loc][src] & (1ULL << dest)) == 0)
     return MOVE_NULL;
 
   // This is a check like the pin checks, but it's not quite a pin: an enpassant
@@ -512,8 +638,8 @@ static Move move_generate_enpassant_move(const Bitboard* board, uint8_t src) {
     // check anyway and this move won't help.
     uint64_t attacks =
         movemagic_rook(king_loc, board->full_composite & ~removed);
-    if ((attacks & board->boards[1 - board->to_move][ROOK]) ||
-        (attacks & board->boards[1 - board->to_move][QUEEN]))
+    if ((attacks & board->boards[1 - color][ROOK]) ||
+        (attacks & board->boards[1 - color][QUEEN]))
       return MOVE_NULL;
   }
 
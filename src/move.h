@@ -23,6 +23,12 @@ void move_generate_movelist(const Bitboard* board,
                             Movelist* movelist,
                             MoveGenMode m);
 
+// The same, but into moves, which needs room for MAX_MOVES. Returns how many
+// moves there are.
+uint8_t move_generate_moves(const Bitboard* board,
+                            Move* moves,
+                            MoveGenMode m);
+
 // does not consider enpassant (this is basically for checking king move and
 // castling viability)
 uint64_t move_generate_attackers(const Bitboard* board,
@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "config.h"
@@ -9,15 +10,36 @@
 #include "see.h"
 #include "types.h"
 
+#if __AVX2__
+#include <immintrin.h>
+#define MOVEITER_AVX 1
+#elif __ARM_NEON && __aarch64__
+#include <arm_neon.h>
+#define MOVEITER_NEON 1
+#endif
+
 // NB: any move with a negative score may be reduced by LMR and pruned by
 // qsearch.
-#define SCORE_TT INT_MAX
+#define SCORE_TT (2 * SHRT_MAX)
 #define SCORE_WINNING_CAPTURE 2
 #define SCORE_KILLER 1
 #define SCORE_COUNTERMOVE 0
 #define SCORE_OTHER (2 * SHRT_MIN - 1)
 #define SCORE_LOSING_CAPTURE (4 * SHRT_MIN - 1)
 
+// moveiter_next packs a score and an index into one int32_t, see
+// MOVEITER_KEY, which leaves 24 bits for the score.
+static_assert(SCORE_TT < (1 << 23), "Scores must fit in 24 bits");
+static_assert(SCORE_LOSING_CAPTURE + SHRT_MIN >= -(1 << 23),
+              "Scores must fit in 24 bits");
+
+// A move's score with its index below it, inverted so that of two moves with
+// the same score, the earlier one has the larger key. Then the largest key
+// is the move a plain scan for the first best score would pick.
+#define MOVEITER_KEY(score, i) \
+  ((int32_t)((uint32_t)(score) << 8 | (uint32_t)(255 - (i))))
+#define MOVEITER_KEY_INDEX(key) ((uint8_t)(255 - ((key)&0xFF)))
+
 static MoveScore moveiter_score(const Bitboard* board,
                                 Move m,
                                 Move tt_move,
@@ -26,20 +48,71 @@ static MoveScore moveiter_score(const Bitboard* board,
 
 void moveiter_init(Moveiter* iter,
                    const Bitboard* board,
-                   Movelist* list,
+                   Move* moves,
+                   MoveScore* scores,
+                   uint8_t n,
                    Move tt_move,
                    const Move* killers,
                    Move countermove) {
-  iter->list = list;
+  iter->moves = moves;
+  iter->scores = scores;
   iter->n = 0;
+  iter->end = n;
 
-  for (uint8_t i = 0; i < list->n; i++)
-    iter->scores[i] =
-        moveiter_score(board, list->moves[i], tt_move, killers, countermove);
+  for (uint8_t i = 0; i < n; i++)
+    scores[i] = moveiter_score(board, moves[i], tt_move, killers, countermove);
 }
 
 int moveiter_has_next(Moveiter* iter) {
-  return iter->n < iter->list->n;
+  return iter->n < iter->end;
+}
+
+// The largest MOVEITER_KEY of scores[start] through scores[end - 1].
+static int32_t moveiter_best_key(const MoveScore* scores,
+                                 uint8_t start,
+                                 uint8_t end) {
+  int32_t best = INT32_MIN;
+  int i = start;
+
+#if MOVEITER_AVX
+  const __m256i order = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i best_vec = _mm256_set1_epi32(INT32_MIN);
+  for (; i + 8 <= end; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(scores + i));
+    __m256i index = _mm256_add_epi32(order, _mm256_set1_epi32(i));
+    __m256i keys =
+        _mm256_or_si256(_mm256_slli_epi32(v, 8),
+                        _mm256_sub_epi32(_mm256_set1_epi32(255), index));
+    best_vec = _mm256_max_epi32(best_vec, keys);
+  }
+
+  __m128i m = _mm_max_epi32(_mm256_castsi256_si128(best_vec),
+                            _mm256_extracti128_si256(best_vec, 1));
+  m = _mm_max_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+  m = _mm_max_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+  best = _mm_cvtsi128_si32(m);
+#elif MOVEITER_NEON
+  const int32_t order_lanes[4] = {0, 1, 2, 3};
+  const int32x4_t order = vld1q_s32(order_lanes);
+  int32x4_t best_vec = vdupq_n_s32(INT32_MIN);
+  for (; i + 4 <= end; i += 4) {
+    int32x4_t v = vld1q_s32(scores + i);
+    int32x4_t index = vaddq_s32(order, vdupq_n_s32(i));
+    int32x4_t keys =
+        vorrq_s32(vshlq_n_s32(v, 8), vsubq_s32(vdupq_n_s32(255), index));
+    best_vec = vmaxq_s32(best_vec, keys);
+  }
+
+  best = vmaxvq_s32(best_vec);
+#endif
+
+  for (; i < end; i++) {
+    int32_t key = MOVEITER_KEY(scores[i], i);
+    if (key > best)
+      best = key;
+  }
+
+  return best;
 }
 
 Move moveiter_next(Moveiter* iter, MoveScore* s_out) {
@@ -49,32 +122,26 @@ Move moveiter_next(Moveiter* iter, MoveScore* s_out) {
   // sort the whole list, but the number of cases where we do that are so
   // outweighed by the cases were we need part of a list that doing this is way
   // faster.
-  Move best_m = iter->list->moves[iter->n];
-  MoveScore best_s = iter->scores[iter->n];
-  uint8_t best_i = iter->n;
-  for (uint8_t i = iter->n + 1; i < iter->list->n; i++) {
-    Move m = iter->list->moves[i];
-    MoveScore s = iter->scores[i];
-    if (s > best_s) {
-      best_s = s;
-      best_m = m;
-      best_i = i;
-    }
-  }
+  Move* moves = iter->moves;
+  MoveScore* scores = iter->scores;
+  uint8_t best_i =
+      MOVEITER_KEY_INDEX(moveiter_best_key(scores, iter->n, iter->end));
+  Move best = moves[best_i];
+  MoveScore best_score = scores[best_i];
 
   // Selection sort swaps the best with the first, but we only need to do half
   // of that since we only make one pass through the list: write the first into
   // the slot where the best was, and then return the best. (Do not bother to
   // write the best back into the first slot, which we will never look at
   // again.)
-  iter->list->moves[best_i] = iter->list->moves[iter->n];
-  iter->scores[best_i] = iter->scores[iter->n];
+  moves[best_i] = moves[iter->n];
+  scores[best_i] = scores[iter->n];
   iter->n++;
   if (s_out)
-    *s_out = best_s;
+    *s_out = best_score;
 
-  assert(best_m != MOVE_NULL);
-  return best_m;
+  assert(best != MOVE_NULL);
+  return best;
 }
 
 static MoveScore moveiter_score(const Bitboard* board,
@@ -9,15 +9,19 @@
 typedef int32_t MoveScore;
 
 typedef struct {
-  Movelist* list;
+  Move* moves;
+  MoveScore* scores;
   uint8_t n;
-  MoveScore scores[MAX_MOVES];
+  uint8_t end;
 } Moveiter;
 
-// May modify the input list
+// Scores the n moves into scores, which needs room for n of them. The iterator
+// reorders both arrays in place as it goes.
 void moveiter_init(Moveiter* iter,
                    const Bitboard* board,
-                   Movelist* list,
+                   Move* moves,
+                   MoveScore* scores,
+                   uint8_t n,
                    Move tt_move,
                    const Move* killers,
                    Move countermove);
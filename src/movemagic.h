@@ -3,7 +3,16 @@
 
 #include <stdint.h>
 
-void movemagic_init(void);
+#include "config.h"
+
+// With BMI2, PEXT packs the occupancy bits under the mask straight into an
+// index, so the magics aren't needed at all. (Some older AMD CPUs have BMI2 but
+// a very slow PEXT; turn off ENABLE_PEXT for those.) The tables in
+// gen/movemagic.h are laid out to match.
+#if ENABLE_PEXT && __BMI2__
+#define MOVEMAGIC_PEXT 1
+#endif
+
 uint64_t movemagic_rook(uint8_t pos, uint64_t occ);
 uint64_t movemagic_bishop(uint8_t pos, uint64_t occ);
 
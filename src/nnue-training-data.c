@@ -6,8 +6,10 @@
 
 #include "bitboard.h"
 #include "config.h"
+#include "evaluate.h"
 #include "move.h"
 #include "mt19937.h"
+#include "nnue.h"
 #include "search.h"
 #include "statelist.h"
 #include "timer.h"
@@ -15,29 +17,33 @@
 
 #define NUM_RANDOM_MOVES 6
 #define MAX_RANDOM_ATTEMPTS 100
-#define USAGE "Usage: nnue-training-data -d depth -g games -o output\n"
+#define USAGE                                                       \
+  "Usage: nnue-training-data -d depth -g games -o output [-e evaluator]\n" \
+  "evaluator is traditional (the default), nnue, or a network file\n"
 
 extern char* optarg;
 
 int main(int argc, char** argv) {
-#if ENABLE_NNUE
-  printf("Turn off ENABLE_NNUE.\n");
-  return 1;
-#endif
-
   mt_srandom((unsigned)time(NULL));
   timer_init_secs(9999);
   move_init();
   search_init();
+#if ENABLE_NNUE
+  nnue_init();
+#endif
 
   char* filename = NULL;
   unsigned num_games = 0;
   uint8_t depth = 0;
+  const char* evaluator = "traditional";
 
   int opt;
 
-  while ((opt = getopt(argc, argv, "d:g:o:")) != -1) {
+  while ((opt = getopt(argc, argv, "d:e:g:o:")) != -1) {
     switch (opt) {
+      case 'e':
+        evaluator = optarg;
+        break;
       case 'd':
         depth = (uint8_t)strtoul(optarg, NULL, 0);
         break;
@@ -58,6 +64,11 @@ int main(int argc, char** argv) {
     exit(1);
   }
 
+  if (evaluate_set_evaluator(evaluator)) {
+    printf("Could not use evaluator %s\n", evaluator);
+    exit(1);
+  }
+
   FILE* f = fopen(filename, "a");
   if (!f) {
     printf("Could not open %s\n", filename);
@@ -79,11 +79,13 @@ static inline int8_t read_i8(FILE* f) {
   return (int8_t)a;
 }
 
-void nnue_init(void) {
-  FILE* f = fmemopen((void*)nnue_bin_data, nnue_bin_size, "rb");
-  if (!f)
-    abort();
+#define NNUE_FILE_SIZE                                                  \
+  (3 * sizeof(uint32_t) +                                               \
+   sizeof(int16_t) * (NNUE_INPUT_LAYER * NNUE_HIDDEN_LAYER +            \
+                      NNUE_HIDDEN_LAYER) +                              \
+   sizeof(int8_t) * 2 * NNUE_HIDDEN_LAYER + sizeof(int16_t))
 
+static void nnue_read(FILE* f) {
   if (read_u32(f) != NNUE_INPUT_LAYER)
     abort();
 
@@ -108,10 +110,46 @@ void nnue_init(void) {
   if (getc(f) != EOF)
     abort();
 
-  fclose(f);
   initalized = 1;
 }
 
+void nnue_init(void) {
+  FILE* f = fmemopen((void*)nnue_bin_data, nnue_bin_size, "rb");
+  if (!f)
+    abort();
+
+  nnue_read(f);
+  fclose(f);
+}
+
+int nnue_load(const char* filename) {
+  FILE* f = fopen(filename, "rb");
+  if (!f) {
+    perror("Failed to open network");
+    return -1;
+  }
+
+  // nnue_read gives up on anything unexpected, so check everything it's going
+  // to look at first. Once the size is right, reading can't hit EOF.
+  int ok = fseek(f, 0, SEEK_END) == 0 && ftell(f) == (long)NNUE_FILE_SIZE;
+  if (ok) {
+    rewind(f);
+    ok = read_u32(f) == NNUE_INPUT_LAYER &&
+         read_u32(f) == NNUE_HIDDEN_LAYER && read_u32(f) == 1;
+  }
+
+  if (!ok) {
+    fprintf(stderr, "Not a network of the right shape: %s\n", filename);
+    fclose(f);
+    return -1;
+  }
+
+  rewind(f);
+  nnue_read(f);
+  fclose(f);
+  return 0;
+}
+
 static void nnue_toggle_piece_into(const Bitboard* board,
                                    Piecetype piece,
                                    Color color,
@@ -7,7 +7,14 @@
 #include "types.h"
 
 #if ENABLE_NNUE
+// Load the network built into the binary.
 void nnue_init(void);
+
+// Replace the network with one from a file, in the same format as the built-in
+// one. Any boards already set up need an nnue_reset afterwards. Returns 0 on
+// success, and leaves the network as it was otherwise.
+int nnue_load(const char* filename);
+
 void nnue_reset(Bitboard* board);
 int16_t nnue_evaluate(const Bitboard* board);
 int16_t nnue_debug_evaluate(const Bitboard* board);
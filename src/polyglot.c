@@ -0,0 +1,97 @@
+#include "polyglot.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitboard.h"
+#include "bitops.h"
+#include "types.h"
+
+#define POLYGLOT_CASTLE 768
+#define POLYGLOT_ENPASSANT 772
+#define POLYGLOT_TURN 780
+
+#define COL_A 0x0101010101010101ULL
+#define COL_H 0x8080808080808080ULL
+
+static uint64_t polyglot_keys[POLYGLOT_NUM_KEYS];
+
+int polyglot_load_keys(const char* filename) {
+  FILE* f = fopen(filename, "r");
+  if (!f) {
+    perror("Failed to open Polyglot keys");
+    return -1;
+  }
+
+  uint64_t keys[POLYGLOT_NUM_KEYS];
+  int n = 0;
+  int prev = EOF;
+  int c;
+  while ((c = fgetc(f)) != EOF) {
+    if (prev == '0' && (c == 'x' || c == 'X')) {
+      if (n == POLYGLOT_NUM_KEYS || fscanf(f, "%16" SCNx64, &keys[n]) != 1)
+        break;
+      n++;
+      c = EOF;
+    }
+    prev = c;
+  }
+
+  int ok = n == POLYGLOT_NUM_KEYS && feof(f);
+  fclose(f);
+  if (!ok) {
+    fprintf(stderr, "Expected %d Polyglot keys: %s\n", POLYGLOT_NUM_KEYS,
+            filename);
+    return -1;
+  }
+
+  polyglot_set_keys(keys);
+  return 0;
+}
+
+void polyglot_set_keys(const uint64_t keys[POLYGLOT_NUM_KEYS]) {
+  memcpy(polyglot_keys, keys, sizeof(polyglot_keys));
+}
+
+uint64_t polyglot_key(const Bitboard* board) {
+  // Polyglot's piece order, with black before white for each.
+  static const int kind[6] = {[PAWN] = 0, [KNIGHT] = 1, [BISHOP] = 2,
+                              [ROOK] = 3, [QUEEN] = 4,  [KING] = 5};
+
+  uint64_t key = 0;
+  for (Color c = WHITE; c <= BLACK; c++) {
+    for (Piecetype p = PAWN; p <= KING; p++) {
+      int offset = 64 * (2 * kind[p] + (c == WHITE));
+      uint64_t pieces = board->boards[c][p];
+      while (pieces) {
+        uint8_t loc = bitscan(pieces);
+        pieces &= pieces - 1;
+        key ^= polyglot_keys[offset + loc];
+      }
+    }
+  }
+
+  static const uint8_t castle_order[4] = {
+      CASTLE_R(CASTLE_R_KS, WHITE), CASTLE_R(CASTLE_R_QS, WHITE),
+      CASTLE_R(CASTLE_R_KS, BLACK), CASTLE_R(CASTLE_R_QS, BLACK)};
+  for (int i = 0; i < 4; i++) {
+    if (board->state->castle_rights & castle_order[i])
+      key ^= polyglot_keys[POLYGLOT_CASTLE + i];
+  }
+
+  uint8_t ep = board->state->enpassant_index;
+  if (ep) {
+    uint64_t pushed = 1ULL << ep;
+    uint64_t beside = ((pushed & ~COL_A) >> 1) | ((pushed & ~COL_H) << 1);
+    if (beside & board->boards[board->to_move][PAWN])
+      key ^= polyglot_keys[POLYGLOT_ENPASSANT + board_col_of(ep)];
+  }
+
+  if (board->to_move == WHITE)
+    key ^= polyglot_keys[POLYGLOT_TURN];
+
+  return key;
+}
@@ -0,0 +1,30 @@
+#ifndef _POLYGLOT_H
+#define _POLYGLOT_H
+
+#include <stdint.h>
+
+#include "types.h"
+
+// Keys of positions as Polyglot opening books have them. These are separate
+// from the engine's own zobrists: Polyglot has its own published table of
+// Random64 keys, xors its side key in for white to move rather than black, and
+// only counts an enpassant file when the side to move has a pawn next to the
+// pawn which just moved up two.
+
+// 12 * 64 piece-square keys, then four castling rights, eight enpassant files
+// and the side to move.
+#define POLYGLOT_NUM_KEYS 781
+
+// Read the Random64 table from a copy of it as published with the book format,
+// i.e., the 781 constants in order, written in hex with a leading 0x, with
+// anything else around them ignored. Returns 0 on success.
+int polyglot_load_keys(const char* filename);
+
+// Use keys as the Random64 table.
+void polyglot_set_keys(const uint64_t keys[POLYGLOT_NUM_KEYS]);
+
+// The key Polyglot books would use for board. Only meaningful once one of the
+// above has set up the table.
+uint64_t polyglot_key(const Bitboard* board);
+
+#endif
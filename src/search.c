@@ -9,12 +9,14 @@
 #include <strings.h>
 #include <unistd.h>
 
+#include "bitbase.h"
 #include "bitops.h"
 #include "config.h"
 #include "evaluate.h"
 #include "history.h"
 #include "move.h"
 #include "moveiter.h"
+#include "syzygy.h"
 #include "timer.h"
 #include "tt.h"
 
@@ -36,9 +38,47 @@
 
 #define LMP_MIN_MOVES 4
 
+// Below the syzygy scores, since bitbases don't know the distance to mate.
+#define BITBASE_WIN_SCORE (MATE / 4)
+
 static int timeup;
 static uint64_t nodes_searched;
 
+// Bumped every time search_is_draw finds a draw by repetition or the 50-move
+// rule. Those depend on the path taken to a position and not just the position
+// itself, so a node which sees this change while searching its subtree must not
+// put its score in the transposition table.
+static uint64_t path_draws;
+
+// Plies are int8_t, so no path is any longer than this.
+#define MAX_PLIES 128
+
+// Zobrists of the positions leading up to the one being searched, at
+// key_history_base + ply: the game before the root, back to its last
+// irreversible move, and then the current search path. Repetition checks scan
+// this instead of chasing State prev pointers at every node.
+#define KEY_HISTORY_GAME_MAX 128
+static uint64_t key_history[KEY_HISTORY_GAME_MAX + MAX_PLIES];
+static int key_history_base;
+
+// The moves of every node on the current search path, and their ordering
+// scores alongside in score_stack. A node at ply generates its moves straight
+// in from move_stack_top[ply] and keeps as many as it got, so the lists being
+// worked through sit together rather than each taking MAX_MOVES of them on the
+// machine stack. (This is sized for the worst case, but only the start of it
+// is ever used.)
+#define MOVE_STACK_SIZE (MAX_PLIES * MAX_MOVES)
+static Move move_stack[MOVE_STACK_SIZE];
+static MoveScore score_stack[MOVE_STACK_SIZE];
+static int move_stack_top[MAX_PLIES + 1];
+
+// The rest of what a node at ply keeps while it searches its children: the
+// principal variation they hand back, and the quiet moves that didn't cut off,
+// for history_update. Like the move lists, these live here rather than in
+// every frame on the machine stack.
+static Move pv_stack[MAX_PLIES][MAX_POSSIBLE_DEPTH + 1];
+static Move bad_quiets_stack[MAX_PLIES][MAX_BAD_QUIETS];
+
 static int search_alpha_beta(Bitboard* board,
                              int alpha,
                              int beta,
@@ -49,8 +89,30 @@ static int search_alpha_beta(Bitboard* board,
 
 static int search_qsearch(Bitboard* board, int alpha, int beta, int8_t ply);
 
+static void search_path_init(const Bitboard* board, int8_t root_ply);
+
+static uint8_t search_generate_moves(const Bitboard* board,
+                                     int8_t ply,
+                                     MoveGenMode m);
+
 static int search_is_draw(const Bitboard* board, int8_t ply);
 
+static int search_upcoming_repetition(const Bitboard* board, int8_t ply);
+
+static int search_bitbase_probe(const Bitboard* board,
+                                int alpha,
+                                int beta,
+                                int8_t ply,
+                                int* score);
+
+static void search_tt_put(const Bitboard* board,
+                          int value,
+                          Move best_move,
+                          TranspositionType type,
+                          int8_t depth,
+                          int8_t ply,
+                          uint64_t path_draws_at_entry);
+
 static void search_print_pv(Move* pv, int8_t depth, FILE* f);
 
 void search_init(void) {
@@ -67,6 +129,21 @@ Move search_find_move(Bitboard* board, const SearchDebug* debug) {
   Move best_move = 0;
   nodes_searched = 0;
   history_clear();
+  search_path_init(board, 0);
+
+#if ENABLE_SYZYGY
+  // Tablebases have a perfect answer, so there's no need to search at all.
+  int tb_score;
+  if (syzygy_probe_root(board, &best_move, &tb_score)) {
+    char buf[6];
+    move_srcdest_form(best_move, buf);
+    fprintf(f, "0\t%i\t0\t0\t%s -> tablebase\n", tb_score, buf);
+    if (debug && debug->score)
+      *debug->score = tb_score;
+    board->generation++;
+    return best_move;
+  }
+#endif
 
   Move pv[MAX_POSSIBLE_DEPTH + 1];
 
@@ -167,7 +244,7 @@ static int search_alpha_beta(Bitboard* board,
                              int8_t ply,
                              Move* pv,
                              uint8_t allow_null) {
-  Move localpv[MAX_POSSIBLE_DEPTH + 1];
+  Move* const localpv = pv_stack[ply];
 
   if (!timeup)
     timeup = timer_timeup();
@@ -181,6 +258,9 @@ static int search_alpha_beta(Bitboard* board,
   assert(alpha < beta);
   nodes_searched++;
 
+  // Nothing is allocated yet for the null move search.
+  move_stack_top[ply + 1] = move_stack_top[ply];
+
   TranspositionType type = TRANSPOSITION_ALPHA;
   const int pv_node = beta > alpha + 1;
 
@@ -190,10 +270,27 @@ static int search_alpha_beta(Bitboard* board,
   if (search_is_draw(board, ply))
     return DRAW;
 
+  // With a repetition one move away, the side to move can always hold a draw,
+  // so there's nothing more to find if that's already enough.
+  if (ply > 0 && beta <= DRAW && search_upcoming_repetition(board, ply))
+    return DRAW;
+
+  // Nothing to find by searching when neither side has enough material to
+  // win. (Unless it's already mate, which always involves a check.)
+  if (ply > 0 && evaluate_is_known_draw(board) &&
+      !board_in_check(board, board->to_move)) {
+    if (pv)
+      pv[0] = MOVE_NULL;
+    return DRAW;
+  }
+
+  const uint64_t path_draws_at_entry = path_draws;
+
   // --- TRANSPOSITION TABLE FETCH
-  const TranspositionNode* n = tt_get(board->state->zobrist);
+  TranspositionNode tt_entry;
+  const TranspositionNode* n = tt_get(board->state->zobrist, &tt_entry);
   if (ply > 0 && n) {
-    int value_from_tt = tt_value(n);
+    int value_from_tt = tt_value(n, ply);
     TranspositionType type_from_tt = tt_type(n);
     int hit = NFINITY;
 
@@ -215,8 +312,33 @@ static int search_alpha_beta(Bitboard* board,
     }
   }
 
-  // --- REVERSE FUTILITY PRUNING
+#if ENABLE_SYZYGY
+  // --- TABLEBASE PROBE
+  // The result is exact no matter how deep we were going to search, so store
+  // it as deep as possible to make sure it gets used from the table next time.
+  int tb_score;
+  if (ply > 0 && syzygy_probe_wdl(board, ply, &tb_score)) {
+    if (pv)
+      pv[0] = MOVE_NULL;
+    search_tt_put(board, tb_score, MOVE_NULL, TRANSPOSITION_EXACT,
+                  MAX_POSSIBLE_DEPTH, ply, path_draws_at_entry);
+    return tb_score;
+  }
+#endif
+
   const int in_check = board_in_check(board, board->to_move);
+
+  // --- BITBASE PROBE
+  // Not when in check, so that mates are still found by the search itself.
+  int bb_score;
+  if (ply > 0 && !in_check &&
+      search_bitbase_probe(board, alpha, beta, ply, &bb_score)) {
+    if (pv)
+      pv[0] = MOVE_NULL;
+    return bb_score;
+  }
+
+  // --- REVERSE FUTILITY PRUNING
   if (!in_check && beta < MATE && depth <= REVERSE_FUTILITY_MAX_DEPTH &&
       ply > 0 && !pv_node && allow_null == ALLOW_NULL_MOVE) {
     // Need to deal with zug (since this prune is very similar to null move).
@@ -240,6 +362,7 @@ static int search_alpha_beta(Bitboard* board,
   if (!in_check && depth > 2 && ply > 0 && !pv_node && eval >= beta &&
       allow_null == ALLOW_NULL_MOVE) {
     const int R = 4;
+    tt_prefetch(board_zobrist_after_move(board, MOVE_NULL));
     State s;
     board_do_move(board, MOVE_NULL, &s);
     int null_value = -search_alpha_beta(board, -beta, -beta + 1, depth - R,
@@ -267,17 +390,18 @@ static int search_alpha_beta(Bitboard* board,
     futile = alpha - eval - margin;
   }
 
-  Movelist moves;
-  move_generate_movelist(board, &moves, MOVE_GEN_ALL);
+  const int moves_at = move_stack_top[ply];
+  uint8_t num_moves = search_generate_moves(board, ply, MOVE_GEN_ALL);
 
-  Move bad_quiets[MAX_BAD_QUIETS];
+  Move* const bad_quiets = bad_quiets_stack[ply];
   int num_bad_quiets = 0;
 
   Move move_from_tt = n ? tt_move(n) : MOVE_NULL;
 
   Moveiter iter;
   const Move* killer_moves = history_get_killers(ply);
-  moveiter_init(&iter, board, &moves, move_from_tt, killer_moves,
+  moveiter_init(&iter, board, move_stack + moves_at, score_stack + moves_at,
+                num_moves, move_from_tt, killer_moves,
                 history_get_countermove(board));
 
   /* since we generate only pseudolegal moves, we need to keep track if
@@ -328,8 +452,14 @@ static int search_alpha_beta(Bitboard* board,
       continue;
     }
 
+    // Start loading the child's table entry now, so it can arrive while we
+    // make the move rather than when the child goes to probe it.
+    const uint64_t child_zobrist = board_zobrist_after_move(board, move);
+    tt_prefetch(child_zobrist);
+
     State s;
     board_do_move(board, move, &s);
+    assert(board->state->zobrist == child_zobrist);
 
     // value from recursive call to alpha-beta search
     int recursive_value;
@@ -381,8 +511,8 @@ static int search_alpha_beta(Bitboard* board,
          since it will be searched first next time, and will
          thus immediately cause a cutoff again */
       if (!timeup) {
-        tt_put(board->state->zobrist, recursive_value, move, TRANSPOSITION_BETA,
-               board->generation, depth);
+        search_tt_put(board, recursive_value, move, TRANSPOSITION_BETA, depth,
+                      ply, path_draws_at_entry);
         history_update(board, move, bad_quiets, num_bad_quiets, depth, ply);
       }
 
@@ -424,8 +554,8 @@ static int search_alpha_beta(Bitboard* board,
     // Do not need to check for timeup here since we do it a few lines above,
     // after which the search of this position is complete and so we are still
     // safe to store even if time is up right now.
-    tt_put(board->state->zobrist, best_score, best_move, type,
-           board->generation, depth);
+    search_tt_put(board, best_score, best_move, type, depth, ply,
+                  path_draws_at_entry);
     return best_score;
   }
 }
@@ -445,13 +575,39 @@ static int search_qsearch(Bitboard* board, int alpha, int beta, int8_t ply) {
   const int pv_node = beta > alpha + 1;
 #endif
 
+  TranspositionType type = TRANSPOSITION_ALPHA;
+  Move best_move = MOVE_NULL;
   int best_score = -NFINITY;
 
   if (search_is_draw(board, ply))
     return DRAW;
 
+  if (beta <= DRAW && search_upcoming_repetition(board, ply))
+    return DRAW;
+
+  const uint64_t path_draws_at_entry = path_draws;
+
+  // --- TRANSPOSITION TABLE FETCH
+  // Any entry is deep enough to use here: either it came from another qsearch,
+  // or from a full-width search which is at least as good.
+  TranspositionNode tt_entry;
+  const TranspositionNode* n = tt_get(board->state->zobrist, &tt_entry);
+  if (n && tt_depth(n) >= TT_DEPTH_QSEARCH) {
+    int value_from_tt = tt_value(n, ply);
+    TranspositionType type_from_tt = tt_type(n);
+
+    if (type_from_tt == TRANSPOSITION_EXACT ||
+        (type_from_tt == TRANSPOSITION_ALPHA && value_from_tt <= alpha) ||
+        (type_from_tt == TRANSPOSITION_BETA && value_from_tt >= beta))
+      return value_from_tt;
+  }
+
   const int in_check = board_in_check(board, board->to_move);
 
+  int bb_score;
+  if (!in_check && search_bitbase_probe(board, alpha, beta, ply, &bb_score))
+    return bb_score;
+
   // Quiescent stand-pat: "you don't have to take". Disallow when in check
   // since the position isn't "quiet" yet and there's no option to "do nothing".
   if (!in_check) {
@@ -459,19 +615,27 @@ static int search_qsearch(Bitboard* board, int alpha, int beta, int8_t ply) {
     best_score = stand_pat;
 
     if (stand_pat >= beta) {
+      search_tt_put(board, stand_pat, MOVE_NULL, TRANSPOSITION_BETA,
+                    TT_DEPTH_QSEARCH, ply, path_draws_at_entry);
       return stand_pat;
     } else if (stand_pat > alpha) {
       alpha = stand_pat;
+      type = TRANSPOSITION_EXACT;
       do_pv_search = 1;
     }
   }
 
-  Movelist moves;
-  move_generate_movelist(board, &moves,
-                         in_check ? MOVE_GEN_ALL : MOVE_GEN_QUIET);
+  const int moves_at = move_stack_top[ply];
+  uint8_t num_moves = search_generate_moves(
+      board, ply, in_check ? MOVE_GEN_ALL : MOVE_GEN_QUIET);
+
+  // If the table move isn't a capture, it just won't be in the list, which is
+  // fine -- it only affects ordering.
+  Move move_from_tt = n ? tt_move(n) : MOVE_NULL;
 
   Moveiter iter;
-  moveiter_init(&iter, board, &moves, MOVE_NULL, history_get_killers(ply),
+  moveiter_init(&iter, board, move_stack + moves_at, score_stack + moves_at,
+                num_moves, move_from_tt, history_get_killers(ply),
                 history_get_countermove(board));
 
   int legal_moves = 0;
@@ -480,7 +644,8 @@ static int search_qsearch(Bitboard* board, int alpha, int beta, int8_t ply) {
     MoveScore score;
     Move move = moveiter_next(&iter, &score);
 
-    if (!in_check && move_is_capture(move) && moveiter_score_to_see(score) < 0)
+    if (!in_check && move_is_capture(move) && move != move_from_tt &&
+        moveiter_score_to_see(score) < 0)
       continue;
 
     if (!move_is_legal(board, move))
@@ -488,6 +653,8 @@ static int search_qsearch(Bitboard* board, int alpha, int beta, int8_t ply) {
 
     legal_moves++;
 
+    tt_prefetch(board_zobrist_after_move(board, move));
+
     State s;
     board_do_move(board, move, &s);
 
@@ -504,9 +671,12 @@ static int search_qsearch(Bitboard* board, int alpha, int beta, int8_t ply) {
     board_undo_move(board);
 
     if (recursive_value >= beta) {
-      if (!timeup)
+      if (!timeup) {
+        search_tt_put(board, recursive_value, move, TRANSPOSITION_BETA,
+                      TT_DEPTH_QSEARCH, ply, path_draws_at_entry);
         history_update(board, move, NULL, 0, 0,
                        ply);  // XXX should we be doing this?
+      }
       return recursive_value;
     }
 
@@ -515,6 +685,8 @@ static int search_qsearch(Bitboard* board, int alpha, int beta, int8_t ply) {
 
     if (recursive_value > alpha) {
       alpha = recursive_value;
+      type = TRANSPOSITION_EXACT;
+      best_move = move;
       do_pv_search = 1;
     }
   }
@@ -528,35 +700,151 @@ static int search_qsearch(Bitboard* board, int alpha, int beta, int8_t ply) {
     if (best_score == -NFINITY)
       best_score = alpha;
 
+    search_tt_put(board, best_score, best_move, type, TT_DEPTH_QSEARCH, ply,
+                  path_draws_at_entry);
     return best_score;
   }
 }
 
+// Set up key_history and the move stack for a search starting at root_ply.
+static void search_path_init(const Bitboard* board, int8_t root_ply) {
+  move_stack_top[root_ply] = 0;
+
+  int n = 0;
+  for (const State* s = board->state->prev;
+       s && n < board->state->halfmove_count && n < KEY_HISTORY_GAME_MAX;
+       s = s->prev)
+    n++;
+
+  const State* s = board->state;
+  for (int i = n; i >= 0; i--, s = s->prev)
+    key_history[i] = s->zobrist;
+
+  key_history_base = n - root_ply;
+}
+
+// Generates the moves at ply onto the move stack, and returns how many.
+static uint8_t search_generate_moves(const Bitboard* board,
+                                     int8_t ply,
+                                     MoveGenMode m) {
+  const int top = move_stack_top[ply];
+  assert(top + MAX_MOVES <= MOVE_STACK_SIZE);
+  uint8_t n = move_generate_moves(board, move_stack + top, m);
+  move_stack_top[ply + 1] = top + n;
+  return n;
+}
+
+// Also records the position in key_history, so every node must go through
+// here before searching its children.
 static int search_is_draw(const Bitboard* board, int8_t ply) {
+  const int index = key_history_base + ply;
+  assert(index >= 0 && index < (int)(sizeof(key_history) / sizeof(uint64_t)));
+  key_history[index] = board->state->zobrist;
+
   // 50-move rule
-  if (board->state->halfmove_count == 100)
+  if (board->state->halfmove_count == 100) {
+    path_draws++;
     return 1;
+  }
 
   // only check for repetitions down at least 1 ply, since it results in a
   // search termination without the game actually being over.
   if (ply > 0) {
-    // 3 repetition rule
-    State* s = board->state;
-    for (int back = board->state->halfmove_count - 2; back >= 0; back -= 2) {
-      s = s->prev;
-      if (!s)
-        break;
-      s = s->prev;
-      if (!s)
-        break;
-      if (s->zobrist == board->state->zobrist)
+    // 3 repetition rule. A position can't repeat any sooner than 4 plies
+    // later, or past the last irreversible move.
+    const int end = board->state->halfmove_count < index
+                        ? board->state->halfmove_count
+                        : index;
+    for (int back = 4; back <= end; back += 2) {
+      if (key_history[index - back] == board->state->zobrist) {
+        path_draws++;
         return 1;
+      }
     }
   }
 
   return 0;
 }
 
+// Can the side to move repeat an earlier position with its next move, which
+// search_is_draw would then score as a draw? Each position an odd number of
+// plies back is checked for being a single move away from this one, which is a
+// lot cheaper than finding that out by searching the move.
+static int search_upcoming_repetition(const Bitboard* board, int8_t ply) {
+  const int index = key_history_base + ply;
+  const int end = board->state->halfmove_count < index
+                      ? board->state->halfmove_count
+                      : index;
+  for (int back = 3; back <= end; back += 2) {
+    uint64_t squares = board_reversible_move_squares(
+        board, board->state->zobrist ^ key_history[index - back]);
+
+    // The move has to be one the side to move could make, i.e., its piece is
+    // on one of the squares. It's then legal too, since the position it leads
+    // to already came up with the other side to move.
+    if (squares & board->composite_boards[board->to_move]) {
+      path_draws++;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+// If there's a bitbase for the position and its result is enough to stop
+// searching, return 1 and fill in score. A draw always is. A win or loss only
+// says which side of the window the score is on: the winning side still has
+// to find the mate, and if every move of a won ending scored the same, nothing
+// would make progress towards it. So only trust one where the ending was just
+// entered or a pawn just moved, and then only if it's outside the window;
+// otherwise the search carries on as it would without bitbases.
+static int search_bitbase_probe(const Bitboard* board,
+                                int alpha,
+                                int beta,
+                                int8_t ply,
+                                int* score) {
+  int result;
+  if (!bitbase_probe(board, &result))
+    return 0;
+
+  if (result == BITBASE_DRAW) {
+    *score = DRAW;
+    return 1;
+  }
+
+  if (board->state->halfmove_count > 0)
+    return 0;
+
+  // Bitbases only say who wins, so add the evaluation to give the winning side
+  // something to make progress towards.
+  if (result == BITBASE_WIN) {
+    *score = BITBASE_WIN_SCORE + evaluate_board(board) - ply;
+    return *score >= beta;
+  } else {
+    *score = -BITBASE_WIN_SCORE + evaluate_board(board) + ply;
+    return *score <= alpha;
+  }
+}
+
+static void search_tt_put(const Bitboard* board,
+                          int value,
+                          Move best_move,
+                          TranspositionType type,
+                          int8_t depth,
+                          int8_t ply,
+                          uint64_t path_draws_at_entry) {
+  // If a repetition or 50-move draw happened anywhere below us, the value may
+  // not hold when this position is reached by some other path. The move is
+  // still a fine guess for ordering, so keep that.
+  // XXX try distinguishing between reps in a search (0 + 2 = draw) and reps in
+  // the actual game continuation (1 + 2 = draw).
+  if (path_draws != path_draws_at_entry)
+    type = TRANSPOSITION_NONE;
+
+  tt_put(board->state->zobrist, value, best_move, type, board->generation,
+         depth, ply);
+}
+
 static void search_print_pv(Move* pv, int8_t depth, FILE* f) {
   char buf[6];
 
@@ -576,6 +864,7 @@ uint64_t search_benchmark(void) {
   board_init_with_fen(
       &board, &s,
       "r2q3k/pn2bprp/4pNp1/2p1PbQ1/3p1P2/5NR1/PPP3PP/2B2RK1 b - - 0 1");
+  search_path_init(&board, 1);
 
   timer_begin();
   for (int8_t depth = 1; depth <= 10; depth++) {
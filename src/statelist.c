@@ -4,49 +4,62 @@
 #include "types.h"
 
 /**
- * Everything in here is just a really dumb/simple singly-linked list, but it
- * works to simply keep track of the states. Would use some stl structure if
- * this were C++. Or I might template it over the type State. Whatever, this is
- * easy and it works. :)
+ * States are handed out from chunks of contiguous storage, since a State can't
+ * move once it's in use (the next State points back at it). Clearing just goes
+ * back to the start of the first chunk; the chunks are kept around to be
+ * reused by the next game, which is usually about as long as the last one.
  */
 
-struct StatelistNode {
-  struct StatelistNode* next;
-  State* s;
+#define STATELIST_CHUNK_STATES 256
+
+struct StatelistChunk {
+  struct StatelistChunk* next;
+  State states[STATELIST_CHUNK_STATES];
 };
 
 struct Statelist {
-  struct StatelistNode* head;
+  struct StatelistChunk* first;
+  struct StatelistChunk* current;
+  size_t used;  // Number of states in current which are handed out.
 };
 
+static struct StatelistChunk* statelist_alloc_chunk(void) {
+  struct StatelistChunk* chunk = malloc(sizeof(struct StatelistChunk));
+  chunk->next = NULL;
+  return chunk;
+}
+
 Statelist* statelist_alloc(void) {
   Statelist* s = malloc(sizeof(Statelist));
-  s->head = NULL;
+  s->first = statelist_alloc_chunk();
+  s->current = s->first;
+  s->used = 0;
   return s;
 }
 
 State* statelist_new_state(Statelist* s) {
-  struct StatelistNode* n = malloc(sizeof(struct StatelistNode));
-  n->s = malloc(sizeof(State));
-  n->next = s->head;
-  s->head = n;
+  if (s->used == STATELIST_CHUNK_STATES) {
+    if (!s->current->next)
+      s->current->next = statelist_alloc_chunk();
+    s->current = s->current->next;
+    s->used = 0;
+  }
 
-  return n->s;
+  return &s->current->states[s->used++];
 }
 
 void statelist_clear(Statelist* s) {
-  struct StatelistNode* n = s->head;
-  while (n) {
-    struct StatelistNode* next = n->next;
-    free(n->s);
-    free(n);
-    n = next;
-  }
-
-  s->head = NULL;
+  s->current = s->first;
+  s->used = 0;
 }
 
 void statelist_free(Statelist* s) {
-  statelist_clear(s);
+  struct StatelistChunk* chunk = s->first;
+  while (chunk) {
+    struct StatelistChunk* next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+
   free(s);
 }
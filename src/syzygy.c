@@ -0,0 +1,107 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bitboard.h"
+#include "bitops.h"
+#include "config.h"
+#include "move.h"
+#include "syzygy.h"
+#include "types.h"
+
+#if ENABLE_SYZYGY
+
+// Probing code from Fathom, https://github.com/jdart1/Fathom, which is expected
+// to be checked out into the top-level fathom directory.
+#include "tbprobe.h"
+
+#define SYZYGY_PIECES(board, p) \
+  ((board)->boards[WHITE][p] | (board)->boards[BLACK][p])
+
+// Fathom wants the square that a pawn could capture onto, we keep the square
+// that the pawn which just moved two squares landed on.
+static unsigned syzygy_ep(const Bitboard* board) {
+  uint8_t ep_index = board->state->enpassant_index;
+  if (ep_index == 0)
+    return 0;
+  return board->to_move == WHITE ? ep_index + 8U : ep_index - 8U;
+}
+
+unsigned syzygy_init(const char* path) {
+  if (!tb_init(path))
+    return 0;
+  return TB_LARGEST;
+}
+
+unsigned syzygy_largest(void) {
+  return TB_LARGEST;
+}
+
+static int syzygy_wdl_to_score(unsigned wdl, int8_t ply) {
+  switch (wdl) {
+    case TB_WIN:
+      return SYZYGY_WIN - ply;
+    case TB_LOSS:
+      return -SYZYGY_WIN + ply;
+    default:
+      // Draws, and also wins and losses which the 50-move rule turns into
+      // draws.
+      return DRAW;
+  }
+}
+
+int syzygy_probe_wdl(const Bitboard* board, int8_t ply, int* score) {
+  if (board->state->halfmove_count != 0 || board->state->castle_rights != 0 ||
+      popcnt(board->full_composite) > TB_LARGEST)
+    return 0;
+
+  unsigned wdl = tb_probe_wdl(
+      board->composite_boards[WHITE], board->composite_boards[BLACK],
+      SYZYGY_PIECES(board, KING), SYZYGY_PIECES(board, QUEEN),
+      SYZYGY_PIECES(board, ROOK), SYZYGY_PIECES(board, BISHOP),
+      SYZYGY_PIECES(board, KNIGHT), SYZYGY_PIECES(board, PAWN), 0, 0,
+      syzygy_ep(board), board->to_move == WHITE);
+  if (wdl == TB_RESULT_FAILED)
+    return 0;
+
+  *score = syzygy_wdl_to_score(wdl, ply);
+  return 1;
+}
+
+int syzygy_probe_root(const Bitboard* board, Move* move, int* score) {
+  if (board->state->castle_rights != 0 ||
+      popcnt(board->full_composite) > TB_LARGEST)
+    return 0;
+
+  unsigned result = tb_probe_root(
+      board->composite_boards[WHITE], board->composite_boards[BLACK],
+      SYZYGY_PIECES(board, KING), SYZYGY_PIECES(board, QUEEN),
+      SYZYGY_PIECES(board, ROOK), SYZYGY_PIECES(board, BISHOP),
+      SYZYGY_PIECES(board, KNIGHT), SYZYGY_PIECES(board, PAWN),
+      board->state->halfmove_count, 0, syzygy_ep(board),
+      board->to_move == WHITE, NULL);
+  if (result == TB_RESULT_FAILED || result == TB_RESULT_CHECKMATE ||
+      result == TB_RESULT_STALEMATE)
+    return 0;
+
+  static const Piecetype promotes[] = {0, QUEEN, ROOK, BISHOP, KNIGHT};
+  uint8_t src = (uint8_t)TB_GET_FROM(result);
+  uint8_t dest = (uint8_t)TB_GET_TO(result);
+  Piecetype promoted = promotes[TB_GET_PROMOTES(result)];
+
+  // Find our version of the move Fathom picked.
+  Movelist moves;
+  move_generate_movelist(board, &moves, MOVE_GEN_ALL);
+  for (int i = 0; i < moves.n; i++) {
+    Move m = moves.moves[i];
+    if (move_source_index(m) == src && move_destination_index(m) == dest &&
+        move_promoted_piecetype(m) == promoted && move_is_legal(board, m)) {
+      *move = m;
+      *score = syzygy_wdl_to_score(TB_GET_WDL(result), 0);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _SYZYGY_H
+#define _SYZYGY_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "types.h"
+
+// Syzygy scores are far from MATE so as to never be confused with an actual
+// mate (which stops the search), but far above anything evaluate_board will
+// return.
+#define SYZYGY_WIN (MATE / 2)
+
+#if ENABLE_SYZYGY
+// Load the tablebases in path (colon-separated list of directories). Returns
+// the largest number of pieces we have tables for, 0 if none.
+unsigned syzygy_init(const char* path);
+
+// Largest number of pieces we can probe, 0 if no tables are loaded.
+unsigned syzygy_largest(void);
+
+// Win/draw/loss probe, suitable to call in search. Only works right after a
+// capture or pawn move and without castling rights (the tables don't know
+// about either). Returns 1 and fills in score, relative to the side to move
+// and adjusted so that nearer wins are preferred, on success.
+int syzygy_probe_wdl(const Bitboard* board, int8_t ply, int* score);
+
+// Distance-to-zero probe, for the root. Unlike syzygy_probe_wdl, respects the
+// 50-move rule. Returns 1 and fills in the move to play and its score on
+// success.
+int syzygy_probe_root(const Bitboard* board, Move* move, int* score);
+#endif
+
+#endif
@@ -0,0 +1,84 @@
+#include <stdio.h>
+
+#include "attackmap.h"
+#include "bitboard.h"
+#include "bitops.h"
+#include "move.h"
+#include "testlib.h"
+#include "types.h"
+
+// clang-format off
+static const char* fens[] = {
+  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+  "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+  "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+  "4r1k1/p1qr1p2/2pb1Bp1/1p5p/3P1n1R/1B3P2/PP3PK1/2Q4R w - - 0 1",
+  "k7/8/8/8/8/8/8/1QQQKQQ1 w - - 0 1",
+  NULL,
+};
+// clang-format on
+
+// Compare against looking up the attackers of each square one by one.
+static int check_board(const Bitboard* board) {
+  AttackMap map;
+  attackmap_generate(board, &map);
+
+  for (Color c = WHITE; c <= BLACK; c++) {
+    uint64_t attacked = 0;
+    uint64_t twice = 0;
+    for (uint8_t sq = 0; sq < 64; sq++) {
+      uint64_t attackers =
+          move_generate_attackers(board, c, sq, board->full_composite);
+      if (attackers)
+        attacked |= 1ULL << sq;
+      if (twobits(attackers))
+        twice |= 1ULL << sq;
+    }
+
+    if (map.attacked[c] != attacked || map.attacked_twice[c] != twice)
+      return 0;
+  }
+
+  return 1;
+}
+
+int main(void) {
+  int ret = 0;
+
+  move_init();
+
+  int num_tests = 0;
+  for (const char** fen = fens; *fen != NULL; fen++) {
+    num_tests++;
+
+    // Check the position itself and everything one move away, for a bit more
+    // variety.
+    Bitboard board;
+    State s;
+    board_init_with_fen(&board, &s, *fen);
+    int ok = check_board(&board);
+
+    Movelist list;
+    move_generate_movelist(&board, &list, MOVE_GEN_ALL);
+    for (int i = 0; ok && i < list.n; i++) {
+      State child;
+      board_do_move(&board, list.moves[i], &child);
+      ok = check_board(&board);
+      board_undo_move(&board);
+    }
+
+    if (ok) {
+      printf("ok - %s\n", *fen);
+    } else {
+      printf("not ok %d - %s\n", num_tests, *fen);
+      ret = 1;
+    }
+  }
+
+  fprintf(stderr, "%s in %0.2f seconds\n", ret == 0 ? "Completed" : "FAILED",
+          test_elapsed_time());
+
+  return ret;
+}
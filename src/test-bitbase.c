@@ -0,0 +1,91 @@
+#include <stdio.h>
+
+#include "bitbase.h"
+#include "bitboard.h"
+#include "config.h"
+#include "move.h"
+#include "nnue.h"
+#include "testlib.h"
+#include "types.h"
+
+typedef struct {
+  const char* fen;
+  int result;
+} TestCase;
+
+// clang-format off
+static const TestCase cases[] = {
+  // King in front of the pawn on the sixth wins whoever moves.
+  {"4k3/8/4K3/4P3/8/8/8/8 w - - 0 1", BITBASE_WIN},
+  {"4k3/8/4K3/4P3/8/8/8/8 b - - 0 1", BITBASE_LOSS},
+  {"8/8/8/8/4p3/4k3/8/4K3 b - - 0 1", BITBASE_WIN},
+  {"8/8/8/8/4p3/4k3/8/4K3 w - - 0 1", BITBASE_LOSS},
+
+  // Rook pawn, and a pawn on the seventh where the defender has the move.
+  {"k7/8/K7/P7/8/8/8/8 w - - 0 1", BITBASE_DRAW},
+  {"4k3/4P3/4K3/8/8/8/8/8 w - - 0 1", BITBASE_WIN},
+  {"4k3/4P3/4K3/8/8/8/8/8 b - - 0 1", BITBASE_DRAW},
+
+  {"8/8/8/4k3/8/8/8/R3K3 b - - 0 1", BITBASE_LOSS},
+  {"k7/2K5/8/8/8/8/8/R7 b - - 0 1", BITBASE_LOSS},
+  {"8/8/8/8/8/8/1k6/R3K3 b - - 0 1", BITBASE_DRAW},
+  {"8/8/8/8/8/8/1k6/R3K3 w - - 0 1", BITBASE_WIN},
+  {"r3k3/8/8/8/8/8/8/4K3 b - - 0 1", BITBASE_WIN},
+
+  {NULL, 0},
+};
+// clang-format on
+
+int main(void) {
+  int ret = 0;
+
+  move_init();
+#if ENABLE_NNUE
+  nnue_init();
+#endif
+
+  int num_tests = 1;
+  // Also generates KQK and KRK, which KPK can promote into.
+  if (bitbase_generate("KPK", NULL) != 0) {
+    printf("not ok %d - generate\n", num_tests);
+    return 1;
+  }
+  printf("ok - generate\n");
+
+  Bitboard board;
+  for (const TestCase* tcase = cases; tcase->fen != NULL; tcase++) {
+    num_tests++;
+
+    State s;
+    board_init_with_fen(&board, &s, tcase->fen);
+
+    int result;
+    if (!bitbase_probe(&board, &result)) {
+      printf("not ok %d - %s missing\n", num_tests, tcase->fen);
+      ret = 1;
+    } else if (result != tcase->result) {
+      printf("not ok %d - %s expected %d got %d\n", num_tests, tcase->fen,
+             tcase->result, result);
+      ret = 1;
+    } else {
+      printf("ok - %s\n", tcase->fen);
+    }
+  }
+
+  // We never generated KBNK.
+  num_tests++;
+  State s;
+  int result;
+  board_init_with_fen(&board, &s, "8/8/8/4k3/8/8/8/B2NK3 b - - 0 1");
+  if (bitbase_probe(&board, &result)) {
+    printf("not ok %d - unexpected KBNK\n", num_tests);
+    ret = 1;
+  } else {
+    printf("ok - no KBNK\n");
+  }
+
+  fprintf(stderr, "%s in %0.2f seconds\n", ret == 0 ? "Completed" : "FAILED",
+          test_elapsed_time());
+
+  return ret;
+}
@@ -0,0 +1,102 @@
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "bitboard.h"
+#include "polyglot.h"
+#include "testlib.h"
+#include "types.h"
+
+typedef struct {
+  const char* fen;
+  uint64_t key;
+} TestCase;
+
+// From the Polyglot book format description, which gives these keys for the
+// position after each of these moves.
+// clang-format off
+static const TestCase published[] = {
+  // start
+  {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 0x463b96181691fc9cULL},
+  // e2e4
+  {"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1", 0x823c9b50fd114196ULL},
+  // e2e4 d7d5
+  {"rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2", 0x0756b94461c50fb0ULL},
+  // e2e4 d7d5 e4e5
+  {"rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR b KQkq - 0 2", 0x662fafb965db29d4ULL},
+  // e2e4 d7d5 e4e5 f7f5
+  {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3", 0x22a48b5a8e47ff78ULL},
+  // e2e4 d7d5 e4e5 f7f5 e1e2
+  {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR b kq - 0 3", 0x652a607ca3f242c1ULL},
+  // e2e4 d7d5 e4e5 f7f5 e1e2 e8f7
+  {"rnbq1bnr/ppp1pkpp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR w - - 0 4", 0x00fdd303c946bdd9ULL},
+  // a2a4 b7b5 h2h4 b5b4 c2c4
+  {"rnbqkbnr/p1pppppp/8/8/PpP4P/8/1P1PPPP1/RNBQKBNR b KQkq c3 0 3", 0x3c8123ea7b067637ULL},
+  // a2a4 b7b5 h2h4 b5b4 c2c4 b4c3 a1a3
+  {"rnbqkbnr/p1pppppp/8/8/P6P/R1p5/1P1PPPP1/1NBQKBNR b Kkq - 0 4", 0x5c3f9b829b279560ULL},
+  {NULL, 0},
+};
+// clang-format on
+
+static uint64_t key_of(const char* fen) {
+  Bitboard board;
+  State s;
+  board_init_with_fen(&board, &s, fen);
+  return polyglot_key(&board);
+}
+
+static int num_tests = 0;
+static int ret = 0;
+
+static void check(int ok, const char* what) {
+  num_tests++;
+  if (ok) {
+    printf("ok %d - %s\n", num_tests, what);
+  } else {
+    printf("not ok %d - %s\n", num_tests, what);
+    ret = 1;
+  }
+}
+
+int main(int argc, char** argv) {
+  // Without the published table, check the rules with made up keys: then the
+  // key of a position shows exactly which entries went into it.
+  uint64_t keys[POLYGLOT_NUM_KEYS];
+  for (int i = 0; i < POLYGLOT_NUM_KEYS; i++)
+    keys[i] = (uint64_t)(i + 1) * 0x9e3779b97f4a7c15ULL;
+  polyglot_set_keys(keys);
+
+  // White king e1 is white king (kind 11), black king e8 is black king (10).
+  check(key_of("4k3/8/8/8/8/8/8/4K3 w - - 0 1") ==
+            (keys[64 * 11 + 4] ^ keys[64 * 10 + 60] ^ keys[780]),
+        "pieces, and side key for white to move");
+  check(key_of("4k3/8/8/8/8/8/8/4K3 b - - 0 1") ==
+            (keys[64 * 11 + 4] ^ keys[64 * 10 + 60]),
+        "no side key for black to move");
+  check((key_of("r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1") ^
+         key_of("r3k2r/8/8/8/8/8/8/R3K2R w - - 0 1")) ==
+            (keys[768] ^ keys[769] ^ keys[770] ^ keys[771]),
+        "castling rights");
+  // Two of the published positions again, without the enpassant square.
+  const char* e4 =
+      "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1";
+  const char* f5 =
+      "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq - 0 3";
+  check(key_of(published[1].fen) == key_of(e4),
+        "enpassant ignored with no pawn to capture");
+  check((key_of(published[4].fen) ^ key_of(f5)) == keys[772 + 5],
+        "enpassant file with a pawn to capture");
+
+  // Given a copy of the published table, check it gives the published keys.
+  if (argc > 1) {
+    int loaded = polyglot_load_keys(argv[1]) == 0;
+    check(loaded, argv[1]);
+    for (const TestCase* t = published; loaded && t->fen; t++)
+      check(key_of(t->fen) == t->key, t->fen);
+  }
+
+  printf("1..%d\n", num_tests);
+  fprintf(stderr, "%s in %0.2f seconds\n", ret == 0 ? "Completed" : "FAILED",
+          test_elapsed_time());
+
+  return ret;
+}
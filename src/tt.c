@@ -1,29 +1,51 @@
 #include <assert.h>
+#include <fcntl.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "bitboard.h"
 #include "config.h"
 #include "move.h"
 #include "tt.h"
 #include "types.h"
 
-struct TranspositionNode {
-  uint32_t zobrist_check;
-  Move best_move;
-  int value;
-  int8_t depth;
-  uint16_t generation;
-} __attribute__((__packed__));
-
 #define TT_WIDTH 4
 #define TT_ENTRIES_EXPONENT 19
 #define TT_ENTRIES (1 << TT_ENTRIES_EXPONENT)
+
+// Snapshot files are a header padded out to TT_FILE_HEADER_SIZE, followed by
+// the raw table. The padding is big enough to be a multiple of any page size
+// we're likely to run on, so that tt_load can map the table portion of the file
+// directly over transposition_table (which is also aligned for that).
+#define TT_FILE_MAGIC 0x54547373656c6d61ULL  // "amlessTT"
+#define TT_FILE_VERSION 2
+#define TT_FILE_HEADER_SIZE 65536
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t node_size;
+  uint32_t entries;
+  uint32_t width;
+  uint64_t zobrist_fingerprint;
+} TranspositionFileHeader;
+
 static TranspositionNode
 #if ENABLE_HUGEPAGES_MADVISE || ENABLE_HUGEPAGES_MMAP
     alignas(4194304)
+#else
+    alignas(TT_FILE_HEADER_SIZE)
 #endif
         transposition_table[TT_ENTRIES][TT_WIDTH];
 
+static_assert(sizeof(transposition_table) % TT_FILE_HEADER_SIZE == 0,
+              "Table must be a whole number of pages to map from a file");
+
 #define INJECT_TYPE(move, type) ((move) | (Move)((type) << move_unused_offset))
 #define EXTRACT_TYPE(move) (((move) >> move_unused_offset) & 0xff)
 #define CLEAN_MOVE(move) ((move)&0x00ffffff)
@@ -37,6 +59,17 @@ static TranspositionNode
 #define TT_INDEX(zobrist) ((zobrist) & (TT_ENTRIES - 1))
 #define TT_ZOBRIST_CHECK(zobrist) ((zobrist) >> 32)
 
+// The table may be shared with other processes (tt_share) writing to it at the
+// same time with no locking, so an entry could be a mix of two writes. To catch
+// that, what we actually store in zobrist_check is the above xor'd with all of
+// the rest of the entry: a torn entry will then (almost certainly) not match
+// any position we look up.
+#define TT_NODE_DATA(node)                       \
+  ((node)->best_move ^ (uint32_t)(node)->value ^ \
+   ((uint32_t)(uint8_t)(node)->depth | (uint32_t)(node)->generation << 8))
+#define TT_NODE_MATCHES(node, zobrist_check) \
+  (((node)->zobrist_check ^ TT_NODE_DATA(node)) == (zobrist_check))
+
 void tt_init(void) {
 #if ENABLE_HUGEPAGES_MMAP
   if (munmap(transposition_table, sizeof(transposition_table)) != 0) {
@@ -66,26 +99,36 @@ void tt_init(void) {
 #endif
 }
 
-const TranspositionNode* tt_get(uint64_t zobrist) {
+void tt_prefetch(uint64_t zobrist) {
   int index = TT_INDEX(zobrist);
-  uint32_t zobrist_check = TT_ZOBRIST_CHECK(zobrist);
 
   for (int i = 0; i < TT_WIDTH; i++)
     __builtin_prefetch(&transposition_table[index][i]);
+}
+
+const TranspositionNode* tt_get(uint64_t zobrist, TranspositionNode* copy) {
+  int index = TT_INDEX(zobrist);
+  uint32_t zobrist_check = TT_ZOBRIST_CHECK(zobrist);
 
   for (int i = 0; i < TT_WIDTH; i++) {
-    TranspositionNode* node = &transposition_table[index][i];
-    if (node->zobrist_check == zobrist_check) {
-      return node;
+    // Copy first, then check the copy, so that what we check is what we use.
+    memcpy(copy, &transposition_table[index][i], sizeof(TranspositionNode));
+    if (TT_NODE_MATCHES(copy, zobrist_check)) {
+      return copy;
     }
   }
 
   return NULL;
 }
 
-int tt_value(const TranspositionNode* n) {
+int tt_value(const TranspositionNode* n, int8_t ply) {
   assert(n);
-  return n->value;
+  int value = n->value;
+  if (value >= MATE)
+    value -= ply;
+  else if (value <= -MATE)
+    value += ply;
+  return value;
 }
 
 Move tt_move(const TranspositionNode* n) {
@@ -108,24 +151,15 @@ void tt_put(uint64_t zobrist,
             Move best_move,
             TranspositionType type,
             uint16_t generation,
-            int8_t depth) {
-  // XXX why is this here, shouldn't the table work for quiescent search too?
-  if (depth < 1)
-    return;
-
-  // An incredibly hacky way of trying to deal with the GHI problem: don't store
-  // path-dependent scores in the table. (Swap the value/type to a pair that
-  // will never be used, but keep the best move.) This doesn't actually solve
-  // the problem, especially for draws, since other evaluations can be based on
-  // a false draw value. But it helps and is straightforward.
-  // XXX try multiplying the eval by <100% as we get closer to 50 move rule (so
-  // scales down smoothly).
-  // XXX try distinguishing between reps in a search (0 + 2 = draw) and reps in
-  // the actual game continuation (1 + 2 = draw).
-  if (value >= MATE || value <= -MATE || value == DRAW) {
-    type = TRANSPOSITION_ALPHA;
-    value = NFINITY;
-  }
+            int8_t depth,
+            int8_t ply) {
+  // Mate scores count plies from the root, but the same position can be
+  // reached at different plies. Store them as distance from this node
+  // instead, and undo that in tt_value.
+  if (value >= MATE)
+    value += ply;
+  else if (value <= -MATE)
+    value -= ply;
 
   int index = TT_INDEX(zobrist);
   uint32_t zobrist_check = TT_ZOBRIST_CHECK(zobrist);
@@ -136,9 +170,14 @@ void tt_put(uint64_t zobrist,
   TranspositionNode* target = NULL;
 
   for (int i = 0; i < TT_WIDTH; i++) {
-    if (transposition_table[index][i].zobrist_check == zobrist_check) {
+    if (TT_NODE_MATCHES(&transposition_table[index][i], zobrist_check)) {
       target = &transposition_table[index][i];
 
+      // A qsearch result for a position is strictly less informative than
+      // a real search of it, so don't let the former clobber the latter.
+      if (depth == TT_DEPTH_QSEARCH && target->depth > depth)
+        return;
+
       // Don't blow away a best_move if we already have one. Beyond that, you
       // would think that only overwriting if the new data is a bigger
       // generation or a deeper depth (otherwise keeping the original entry)
@@ -179,10 +218,197 @@ void tt_put(uint64_t zobrist,
   }
 
   if (target) {
-    target->zobrist_check = zobrist_check;
     target->depth = depth;
     target->generation = generation;
     target->value = value;
     target->best_move = INJECT_TYPE(best_move, type);
+    target->zobrist_check = zobrist_check ^ TT_NODE_DATA(target);
   }
 }
+
+static TranspositionFileHeader tt_file_header(void) {
+  TranspositionFileHeader h = {0};
+  h.magic = TT_FILE_MAGIC;
+  h.version = TT_FILE_VERSION;
+  h.node_size = sizeof(TranspositionNode);
+  h.entries = TT_ENTRIES;
+  h.width = TT_WIDTH;
+  h.zobrist_fingerprint = board_zobrist_fingerprint();
+  return h;
+}
+
+int tt_save(const char* filename) {
+  // Write to a temporary and move it into place, so that we never truncate a
+  // file which might currently be mapped as the table by tt_load.
+  char tmp_filename[1024];
+  if (snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename) >=
+      (int)sizeof(tmp_filename)) {
+    fprintf(stderr, "Filename too long: %s\n", filename);
+    return -1;
+  }
+
+  FILE* f = fopen(tmp_filename, "wb");
+  if (!f) {
+    perror("Failed to open transposition table snapshot");
+    return -1;
+  }
+
+  TranspositionFileHeader h = tt_file_header();
+  if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+      fseek(f, TT_FILE_HEADER_SIZE, SEEK_SET) != 0 ||
+      fwrite(transposition_table, sizeof(transposition_table), 1, f) != 1) {
+    perror("Failed to write transposition table snapshot");
+    fclose(f);
+    unlink(tmp_filename);
+    return -1;
+  }
+
+  if (fclose(f) != 0 || rename(tmp_filename, filename) != 0) {
+    perror("Failed to write transposition table snapshot");
+    unlink(tmp_filename);
+    return -1;
+  }
+
+  return 0;
+}
+
+int tt_load(const char* filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    perror("Failed to open transposition table snapshot");
+    return -1;
+  }
+
+  TranspositionFileHeader expected = tt_file_header();
+  TranspositionFileHeader h;
+  struct stat st;
+  if (pread(fd, &h, sizeof(h), 0) != sizeof(h) || fstat(fd, &st) != 0 ||
+      st.st_size <
+          (off_t)(TT_FILE_HEADER_SIZE + sizeof(transposition_table))) {
+    fprintf(stderr, "Truncated transposition table snapshot: %s\n", filename);
+    close(fd);
+    return -1;
+  }
+
+  if (h.magic != expected.magic || h.version != expected.version ||
+      h.node_size != expected.node_size || h.entries != expected.entries ||
+      h.width != expected.width ||
+      h.zobrist_fingerprint != expected.zobrist_fingerprint) {
+    fprintf(stderr, "Incompatible transposition table snapshot: %s\n",
+            filename);
+    close(fd);
+    return -1;
+  }
+
+  // Map the file copy-on-write directly over the table: nothing is read until
+  // search touches it, and nothing search does is written back to the file.
+  if (mmap(transposition_table, sizeof(transposition_table),
+           PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+           TT_FILE_HEADER_SIZE) == MAP_FAILED) {
+    perror("Failed to map transposition table snapshot, reading instead");
+
+    // A failed MAP_FIXED may have left a hole where the table was.
+    if (mmap(transposition_table, sizeof(transposition_table),
+             PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1,
+             0) == MAP_FAILED) {
+      perror("Failed to remap transposition table");
+      abort();
+    }
+
+    char* p = (char*)transposition_table;
+    size_t remaining = sizeof(transposition_table);
+    off_t offset = TT_FILE_HEADER_SIZE;
+    while (remaining > 0) {
+      ssize_t n = pread(fd, p, remaining, offset);
+      if (n <= 0) {
+        perror("Failed to read transposition table snapshot");
+        close(fd);
+        return -1;
+      }
+      p += n;
+      remaining -= (size_t)n;
+      offset += n;
+    }
+  }
+
+  close(fd);
+  return 0;
+}
+
+int tt_share(const char* name) {
+  const size_t size = TT_FILE_HEADER_SIZE + sizeof(transposition_table);
+  TranspositionFileHeader expected = tt_file_header();
+  TranspositionFileHeader h;
+
+  // Whoever manages to create the segment sizes it and writes the header. It's
+  // the same layout as a snapshot file, and everyone else checks it the same
+  // way before mapping it.
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd >= 0) {
+    if (ftruncate(fd, (off_t)size) != 0 ||
+        pwrite(fd, &expected, sizeof(expected), 0) != sizeof(expected)) {
+      perror("Failed to set up shared transposition table");
+      close(fd);
+      shm_unlink(name);
+      return -1;
+    }
+  } else {
+    fd = shm_open(name, O_RDWR, 0600);
+    if (fd < 0) {
+      perror("Failed to open shared transposition table");
+      return -1;
+    }
+
+    // The creator might not have gotten around to writing the header yet.
+    for (int tries = 0;; tries++) {
+      struct stat st;
+      if (fstat(fd, &st) == 0 && st.st_size >= (off_t)size &&
+          pread(fd, &h, sizeof(h), 0) == sizeof(h) && h.magic != 0)
+        break;
+
+      if (tries >= 100) {
+        fprintf(stderr, "Shared transposition table never set up: %s\n",
+                name);
+        close(fd);
+        return -1;
+      }
+
+      usleep(10000);
+    }
+
+    if (memcmp(&h, &expected, sizeof(h)) != 0) {
+      fprintf(stderr, "Incompatible shared transposition table: %s\n", name);
+      close(fd);
+      return -1;
+    }
+  }
+
+  if (mmap(transposition_table, sizeof(transposition_table),
+           PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd,
+           TT_FILE_HEADER_SIZE) == MAP_FAILED) {
+    perror("Failed to map shared transposition table");
+
+    // A failed MAP_FIXED may have left a hole where the table was.
+    if (mmap(transposition_table, sizeof(transposition_table),
+             PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1,
+             0) == MAP_FAILED) {
+      perror("Failed to remap transposition table");
+      abort();
+    }
+
+    close(fd);
+    return -1;
+  }
+
+  close(fd);
+  return 0;
+}
+
+int tt_unshare(const char* name) {
+  if (shm_unlink(name) != 0) {
+    perror("Failed to remove shared transposition table");
+    return -1;
+  }
+
+  return 0;
+}
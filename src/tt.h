@@ -8,15 +8,53 @@
 #define TRANSPOSITION_EXACT 0
 #define TRANSPOSITION_ALPHA 1
 #define TRANSPOSITION_BETA 2
+// No usable bound on the value, only the best move is meaningful.
+#define TRANSPOSITION_NONE 3
 typedef uint8_t TranspositionType;
 
-struct TranspositionNode;
-typedef struct TranspositionNode TranspositionNode;
+// Depth recorded for entries stored by quiescent search. Full-width search
+// always stores with depth >= 1, so these never satisfy a real search probe,
+// but are usable by any later qsearch probe.
+#define TT_DEPTH_QSEARCH 0
+
+// Treat as opaque, use the accessors below. Only here so that callers can hold
+// a copy of one.
+typedef struct {
+  uint32_t zobrist_check;
+  Move best_move;
+  int value;
+  int8_t depth;
+  uint16_t generation;
+} __attribute__((__packed__)) TranspositionNode;
 
 void tt_init(void);
 
-const TranspositionNode* tt_get(uint64_t zobrist);
-int tt_value(const TranspositionNode* n);
+// Write the whole table to filename, or replace the table with one previously
+// written there. Snapshots are only usable by a build with the same table
+// layout and zobrist keys. Return 0 on success.
+int tt_save(const char* filename);
+int tt_load(const char* filename);
+
+// Replace the table with the named POSIX shared memory segment, creating it if
+// needed, so that several processes can share search results. Return 0 on
+// success. The segment outlives the processes using it, until tt_unshare.
+int tt_share(const char* name);
+
+// Remove the named shared memory segment. Processes already sharing it carry
+// on, and its memory is freed once the last of them exits or replaces its
+// table. Return 0 on success.
+int tt_unshare(const char* name);
+
+// Start pulling the entries for zobrist into cache, ahead of a tt_get.
+void tt_prefetch(uint64_t zobrist);
+
+// Copies the entry for zobrist, if any, into copy and returns it, otherwise
+// returns NULL. (The table may be shared and changing underneath us, so we
+// can't hand out pointers into it.)
+const TranspositionNode* tt_get(uint64_t zobrist, TranspositionNode* copy);
+// Mate scores are stored relative to the node they were found at, so ply is
+// needed to turn them back into scores relative to the root.
+int tt_value(const TranspositionNode* n, int8_t ply);
 Move tt_move(const TranspositionNode* n);
 TranspositionType tt_type(const TranspositionNode* n);
 int8_t tt_depth(const TranspositionNode* n);
@@ -35,6 +73,7 @@ void tt_put(uint64_t zobrist,
             Move best_move,
             TranspositionType type,
             uint16_t generation,
-            int8_t depth);
+            int8_t depth,
+            int8_t ply);
 
 #endif
@@ -18,6 +18,9 @@ typedef unsigned char Piecetype;
 #define QUEEN 4
 #define KING 5
 
+// Marks an empty square in Bitboard's squares.
+#define NO_PIECE 6
+
 #define CASTLE_R_KS (1 << 0)
 #define CASTLE_R_QS (1 << 2)
 #define CASTLE_R_BOTH (CASTLE_R_KS | CASTLE_R_QS)
@@ -73,33 +76,60 @@ typedef struct State {
   // struct?
   uint64_t zobrist;
 
+  // Zobrist of just the pawns, for the pawn hash table.
+  uint64_t pawn_zobrist;
+
+  // Piece counts, see MATERIAL_KEY.
+  uint64_t material_key;
+
   // ----- Everything above prev is copied into the new state when a move is
   //       made!
   struct State* prev;
   // ----- Everything below prev is not!
 
+  // Which of the fields below have been computed yet, see STATE_COMPUTED_*.
+  // Lots of nodes are cut off before they need them, so they are only filled
+  // in on first use, e.g., via board_king_attackers and board_pinned.
+  uint8_t computed;
+
   uint64_t king_attackers;
   uint64_t pinned;
+
+  // For move_gives_check: the squares from which each type of piece of the
+  // side to move would attack the enemy king, and the pieces of the side to
+  // move which could discover a check by moving off their line to it.
+  uint64_t check_squares[6];
+  uint64_t discoverers;
 } State;
 
+#define STATE_COMPUTED_KING_ATTACKERS (1 << 0)
+#define STATE_COMPUTED_PINNED (1 << 1)
+#define STATE_COMPUTED_CHECK_INFO (1 << 2)
+
 typedef struct {
   uint64_t boards[2][6];
   uint64_t composite_boards[2];
   uint64_t full_composite;
 
+  // The Piecetype on each square, or NO_PIECE, so that looking up what is on a
+  // square doesn't have to search through boards.
+  Piecetype squares[64];
+
   State* state;
 
   Color to_move;
   uint16_t generation;
 
+  // Running material plus square table sums for the traditional evaluation,
+  // from white's point of view, with the middlegame and endgame tables.
+  int16_t material[2];
+
+  // Number of pieces on the board which aren't pawns, kings included.
+  uint8_t phase;
+
 #if ENABLE_NNUE
   int16_t alignas(32) nnue_hidden[2][NNUE_HIDDEN_LAYER];
 #endif
-
-  uint64_t zobrist_pos[2][6][64];
-  uint64_t zobrist_castle[256];
-  uint64_t zobrist_enpassant[8];
-  uint64_t zobrist_black;
 } Bitboard;
 
 typedef struct {
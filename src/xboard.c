@@ -5,6 +5,7 @@
 #include <string.h>
 #include <time.h>
 
+#include "bitbase.h"
 #include "bitboard.h"
 #include "config.h"
 #include "evaluate.h"
@@ -13,9 +14,12 @@
 #include "mt19937.h"
 #include "nnue.h"
 #include "perftfn.h"
+#include "polyglot.h"
 #include "search.h"
 #include "statelist.h"
+#include "syzygy.h"
 #include "timer.h"
+#include "tt.h"
 #include "types.h"
 
 static const int max_input_length = 1024;
@@ -92,6 +96,9 @@ int main(int argc, char** argv) {
     if (!strcmp("xboard\n", input)) {
       printf(
           "feature colors=0 setboard=1 time=0 sigint=0 sigterm=0 "
+#if ENABLE_SYZYGY
+          "egt=\"syzygy\" "
+#endif
           "variants=\"normal\" myname=\"nameless\" done=1\n");
     } else if (!strcmp("new\n", input)) {
       statelist_clear(sl);
@@ -110,6 +117,12 @@ int main(int argc, char** argv) {
     } else if (!strncmp("result", input, 6)) {
       computer_player = (Color)-1;
       game_on = 0;
+#if ENABLE_SYZYGY
+    } else if (!strncmp("egtpath syzygy ", input, 15)) {
+      input[strcspn(input, "\n")] = '\0';
+      if (syzygy_init(input + 15) == 0)
+        printf("Error (no tablebases found): %s\n", input + 15);
+#endif
     } else if (!strncmp("level ", input, 6)) {
       timer_init_xboard(input);
     } else if (!strcmp("_print\n", input) || !strncmp("_perft ", input, 7)) {
@@ -123,7 +136,7 @@ int main(int argc, char** argv) {
              evaluate_traditional(&board), nnue);
       assert(nnue == nnue_debug_evaluate(&board));
 #else
-      printf("Evaluation: %i\n", evaluate_board(board));
+      printf("Evaluation: %i\n", evaluate_board(&board));
 #endif
       puts("Pseudolegal moves: ");
 
@@ -157,6 +170,38 @@ int main(int argc, char** argv) {
         printf("\n");
     } else if (!strcmp("_searchonly\n", input)) {
       search_find_move(&board, NULL);
+    } else if (!strncmp("_ttsave ", input, 8) ||
+               !strncmp("_ttload ", input, 8)) {
+      input[strcspn(input, "\n")] = '\0';
+      int err = input[3] == 's' ? tt_save(input + 8) : tt_load(input + 8);
+      if (err)
+        printf("Error (could not %s table): %s\n",
+               input[3] == 's' ? "save" : "load", input + 8);
+    } else if (!strncmp("_ttshare ", input, 9)) {
+      input[strcspn(input, "\n")] = '\0';
+      if (tt_share(input + 9))
+        printf("Error (could not share table): %s\n", input + 9);
+    } else if (!strncmp("_ttunshare ", input, 11)) {
+      input[strcspn(input, "\n")] = '\0';
+      if (tt_unshare(input + 11))
+        printf("Error (could not unshare table): %s\n", input + 11);
+    } else if (!strncmp("_evaluator ", input, 11)) {
+      input[strcspn(input, "\n")] = '\0';
+      if (evaluate_set_evaluator(input + 11))
+        printf("Error (could not use evaluator): %s\n", input + 11);
+#if ENABLE_NNUE
+      nnue_reset(&board);
+#endif
+    } else if (!strncmp("_polyglot ", input, 10)) {
+      input[strcspn(input, "\n")] = '\0';
+      if (polyglot_load_keys(input + 10))
+        printf("Error (could not load Polyglot keys): %s\n", input + 10);
+      else
+        printf("%016" PRIx64 "\n", polyglot_key(&board));
+    } else if (!strncmp("_bitbases ", input, 10)) {
+      input[strcspn(input, "\n")] = '\0';
+      if (bitbase_init(input + 10))
+        printf("Error (could not build bitbases): %s\n", input + 10);
     } else if (input[0] >= 'a' && input[0] <= 'h' && input[1] >= '1' &&
                input[1] <= '8' && input[2] >= 'a' && input[2] <= 'h' &&
                input[3] >= '1' && input[3] <= '8') {